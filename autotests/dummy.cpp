@@ -29,9 +29,27 @@ KGlobalAccelImpl::~KGlobalAccelImpl()
 
 bool KGlobalAccelImpl::grabKey(int keyQt, bool grab)
 {
-    Q_UNUSED(keyQt);
-    Q_UNUSED(grab);
-    return true;
+    return !grab || !m_contestedKeys.contains(keyQt);
+}
+
+void KGlobalAccelImpl::setModifierOnlyShortcutsActive(bool active)
+{
+    m_modifierOnlyShortcutsActive = active;
+}
+
+bool KGlobalAccelImpl::modifierOnlyShortcutsActive() const
+{
+    return m_modifierOnlyShortcutsActive;
+}
+
+QList<int> KGlobalAccelImpl::contestedKeys() const
+{
+    return m_contestedKeys;
+}
+
+void KGlobalAccelImpl::setContestedKeys(const QList<int> &keys)
+{
+    m_contestedKeys = keys;
 }
 
 bool KGlobalAccelImpl::checkKeyEvent(int keyQt, ShortcutKeyState state)
@@ -41,6 +41,12 @@ public:
      * \return true if successful, otherwise false.
      */
     bool grabKey(int key, bool grab) override;
+    void setModifierOnlyShortcutsActive(bool active) override;
+    QList<int> contestedKeys() const override;
+
+    bool modifierOnlyShortcutsActive() const;
+    //! Grabs of @p keys fail as if another client held them
+    void setContestedKeys(const QList<int> &keys);
 
     static KGlobalAccelImpl *instance();
 
@@ -48,6 +54,10 @@ public Q_SLOTS:
     bool checkKeyEvent(int keyQt, ShortcutKeyState state);
     bool checkPointerPressed(Qt::MouseButtons button);
     bool checkAxisTriggered(int axis);
+
+private:
+    bool m_modifierOnlyShortcutsActive = false;
+    QList<int> m_contestedKeys;
 };
 
 #endif // DUMMY_H
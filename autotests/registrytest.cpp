@@ -0,0 +1,205 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <QTest>
+
+#include "component.h"
+#include "dummy.h"
+#include "globalshortcutsregistry.h"
+
+#include <KConfig>
+#include <KConfigGroup>
+
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+
+Q_IMPORT_PLUGIN(KGlobalAccelImpl)
+
+class RegistryTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testServiceFileWatcher();
+    void testServiceDirectoryCreated();
+    void testDormantComponent();
+    void testConfigReload();
+    void testFinishComponentTasks();
+};
+
+void RegistryTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    qunsetenv("XDG_DATA_DIRS");
+    qputenv("KGLOBALACCELD_PLATFORM", "dummy");
+
+    QDir configDir(QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation));
+    configDir.mkpath(QStringLiteral("."));
+    configDir.remove(QStringLiteral("kglobalshortcutsrc"));
+}
+
+void RegistryTest::testServiceFileWatcher()
+{
+    const QString componentName = QStringLiteral("org.kde.test.desktop");
+
+    QDir dataDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation));
+    QVERIFY(dataDir.mkpath(QStringLiteral("kglobalaccel")));
+    const QString serviceFile = dataDir.filePath(QStringLiteral("kglobalaccel/") + componentName);
+    QFile::remove(serviceFile);
+
+    GlobalShortcutsRegistry registry;
+    registry.loadSettings();
+    QVERIFY(!registry.getComponent(componentName));
+
+    // Dropping a file in the directory creates the component
+    QVERIFY(QFile::copy(QFINDTESTDATA("org.kde.test.desktop"), serviceFile));
+    QTRY_VERIFY(registry.getComponent(componentName));
+    QCOMPARE(registry.getComponent(componentName)->friendlyName(), QStringLiteral("Test Service"));
+    QCOMPARE(registry.getShortcutByKey(QKeySequence(Qt::META | Qt::Key_T))->uniqueName(), QStringLiteral("_launch"));
+
+    // The service is not kept around, but can be found again when needed
+    auto *serviceComponent = qobject_cast<KServiceActionComponent *>(registry.getComponent(componentName));
+    QVERIFY(serviceComponent);
+    QCOMPARE(serviceComponent->service()->entryPath(), serviceFile);
+
+    // Removing it removes the component again
+    QVERIFY(QFile::remove(serviceFile));
+    QTRY_VERIFY(!registry.getComponent(componentName));
+    QVERIFY(!registry.getShortcutByKey(QKeySequence(Qt::META | Qt::Key_T)));
+}
+
+void RegistryTest::testServiceDirectoryCreated()
+{
+    const QString componentName = QStringLiteral("org.kde.test.desktop");
+
+    QDir dataDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation));
+    QVERIFY(dataDir.mkpath(QStringLiteral(".")));
+    QDir(dataDir.filePath(QStringLiteral("kglobalaccel"))).removeRecursively();
+
+    // The directory is not created by the registry, it is noticed once someone else creates it
+    GlobalShortcutsRegistry registry;
+    registry.loadSettings();
+    QVERIFY(!dataDir.exists(QStringLiteral("kglobalaccel")));
+
+    QVERIFY(dataDir.mkpath(QStringLiteral("kglobalaccel")));
+    QVERIFY(QFile::copy(QFINDTESTDATA("org.kde.test.desktop"), dataDir.filePath(QStringLiteral("kglobalaccel/") + componentName)));
+    QTRY_VERIFY(registry.getComponent(componentName));
+
+    QVERIFY(QFile::remove(dataDir.filePath(QStringLiteral("kglobalaccel/") + componentName)));
+    QTRY_VERIFY(!registry.getComponent(componentName));
+}
+
+void RegistryTest::testDormantComponent()
+{
+    const QString componentName = QStringLiteral("org.kde.dormant");
+    const QKeySequence key(Qt::META | Qt::Key_D);
+
+    {
+        KConfig config(QStringLiteral("kglobalshortcutsrc"), KConfig::SimpleConfig);
+        KConfigGroup group = config.group(componentName);
+        group.writeEntry("_k_friendly_name", QStringLiteral("Dormant Component"));
+        group.writeEntry("action", QStringList{QStringLiteral("Meta+D"), QStringLiteral("Meta+D"), QStringLiteral("Dormant Action")});
+        config.sync();
+    }
+
+    GlobalShortcutsRegistry registry;
+    registry.loadSettings();
+    registry.finishPendingTasks();
+
+    // Listed and considered for conflicts without being loaded
+    QVERIFY(registry.allComponentNames().contains(QStringList{componentName, QStringLiteral("Dormant Component"), {}, {}}));
+    QVERIFY(!registry.isShortcutAvailable(key, QStringLiteral("org.kde.other"), QStringLiteral("default")));
+    QVERIFY(registry.isShortcutAvailable(QKeySequence(Qt::META | Qt::Key_E), QStringLiteral("org.kde.other"), QStringLiteral("default")));
+
+    // Loaded completely once asked for
+    Component *component = registry.getComponent(componentName);
+    QVERIFY(component);
+    GlobalShortcut *shortcut = component->getShortcutByName(QStringLiteral("action"));
+    QVERIFY(shortcut);
+    QCOMPARE(shortcut->friendlyName(), QStringLiteral("Dormant Action"));
+    QCOMPARE(shortcut->keys(), QList<QKeySequence>{key});
+    QVERIFY(!shortcut->isPresent());
+    QCOMPARE(registry.getShortcutByKey(key), shortcut);
+    QCOMPARE(registry.allComponentNames().count(QStringList{componentName, QStringLiteral("Dormant Component"), {}, {}}), 1);
+}
+
+void RegistryTest::testConfigReload()
+{
+    const QString componentName = QStringLiteral("org.kde.reload");
+    auto writeConfig = [&componentName](const QString &keys, bool withOtherAction) {
+        // A new KConfig every time, like a separate tool would do
+        KConfig config(QStringLiteral("kglobalshortcutsrc"), KConfig::SimpleConfig);
+        KConfigGroup group = config.group(componentName);
+        group.writeEntry("_k_friendly_name", QStringLiteral("Reload Component"));
+        group.writeEntry("action", QStringList{keys, QStringLiteral("Meta+R"), QStringLiteral("Reload Action")});
+        if (withOtherAction) {
+            group.writeEntry("other", QStringList{QStringLiteral("Meta+O"), QStringLiteral("none"), QStringLiteral("Other Action")});
+        }
+        config.sync();
+    };
+    writeConfig(QStringLiteral("Meta+R"), false);
+
+    GlobalShortcutsRegistry registry;
+    registry.loadSettings();
+    registry.finishPendingTasks();
+
+    Component *component = registry.getComponent(componentName);
+    QVERIFY(component);
+    GlobalShortcut *shortcut = component->getShortcutByName(QStringLiteral("action"));
+    QVERIFY(shortcut);
+    QCOMPARE(shortcut->keys(), QList<QKeySequence>{QKeySequence(Qt::META | Qt::Key_R)});
+
+    // Changes made by someone else are applied to the existing shortcuts
+    writeConfig(QStringLiteral("Meta+Shift+R"), true);
+    QTRY_COMPARE(shortcut->keys(), QList<QKeySequence>{QKeySequence(Qt::META | Qt::SHIFT | Qt::Key_R)});
+    GlobalShortcut *other = component->getShortcutByName(QStringLiteral("other"));
+    QVERIFY(other);
+    QCOMPARE(other->friendlyName(), QStringLiteral("Other Action"));
+    QCOMPARE(registry.getShortcutByKey(QKeySequence(Qt::META | Qt::Key_O)), other);
+
+    // Shortcuts gone from the file are removed, unless their application is present
+    {
+        KConfig config(QStringLiteral("kglobalshortcutsrc"), KConfig::SimpleConfig);
+        config.group(componentName).deleteEntry("other");
+        config.sync();
+    }
+    QTRY_VERIFY(!component->getShortcutByName(QStringLiteral("other")));
+    QCOMPARE(component->getShortcutByName(QStringLiteral("action")), shortcut);
+}
+
+void RegistryTest::testFinishComponentTasks()
+{
+    const QString firstName = QStringLiteral("org.kde.first");
+    const QString secondName = QStringLiteral("org.kde.second");
+    {
+        KConfig config(QStringLiteral("kglobalshortcutsrc"), KConfig::SimpleConfig);
+        config.group(firstName).writeEntry("action", QStringList{QStringLiteral("Meta+1"), QStringLiteral("Meta+1"), QStringLiteral("First Action")});
+        config.group(secondName).writeEntry("action", QStringList{QStringLiteral("Meta+2"), QStringLiteral("Meta+2"), QStringLiteral("Second Action")});
+        config.sync();
+    }
+
+    GlobalShortcutsRegistry registry;
+    registry.loadSettings();
+
+    // Only the first component is loaded, the second one is still queued
+    registry.finishPendingTasks(firstName);
+    QVERIFY(!registry.isShortcutAvailable(QKeySequence(Qt::META | Qt::Key_1), QStringLiteral("org.kde.other"), QStringLiteral("default")));
+    QVERIFY(registry.isShortcutAvailable(QKeySequence(Qt::META | Qt::Key_2), QStringLiteral("org.kde.other"), QStringLiteral("default")));
+
+    registry.finishPendingTasks();
+    QVERIFY(!registry.isShortcutAvailable(QKeySequence(Qt::META | Qt::Key_2), QStringLiteral("org.kde.other"), QStringLiteral("default")));
+
+    // Loaded once, even though nothing is queued anymore
+    registry.loadSettings();
+    registry.finishPendingTasks();
+    QCOMPARE(registry.allComponentNames().count(QStringList{firstName, firstName, {}, {}}), 1);
+}
+
+QTEST_MAIN(RegistryTest)
+
+#include "registrytest.moc"
@@ -9,13 +9,63 @@
 #include "dummy.h"
 #include "kglobalacceld.h"
 #include "component.h"
+#include "globalshortcutsregistry.h"
+#include "shortcuteventchannel.h"
 
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusPendingReply>
+#include <QDBusUnixFileDescriptor>
 #include <QPluginLoader>
+#include <QScopeGuard>
 #include <QSignalSpy>
 #include <QStandardPaths>
 
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 Q_IMPORT_PLUGIN(KGlobalAccelImpl)
 
+//! A client of the daemon with a bus name of its own, it leaves the bus when destroyed
+class BusClient
+{
+public:
+    explicit BusClient(const QString &name)
+        : m_name(name)
+        , m_connection(QDBusConnection::connectToBus(QDBusConnection::SessionBus, name))
+    {
+    }
+    ~BusClient()
+    {
+        QDBusConnection::disconnectFromBus(m_name);
+    }
+
+    QDBusConnection connection() const
+    {
+        return m_connection;
+    }
+
+    //! Calls @p method of the daemon and returns the reply, the event loop keeps running for the daemon meanwhile
+    QDBusMessage call(const QString &method, const QVariantList &arguments) const
+    {
+        QDBusMessage message =
+            QDBusMessage::createMethodCall(QStringLiteral("org.kde.kglobalaccel"), QStringLiteral("/kglobalaccel"), QStringLiteral("org.kde.KGlobalAccel"), method);
+        message.setArguments(arguments);
+        QDBusPendingCall call = m_connection.asyncCall(message);
+        QTest::qWaitFor([&call] {
+            return call.isFinished();
+        });
+        return call.reply();
+    }
+
+private:
+    QString m_name;
+    QDBusConnection m_connection;
+};
+
 class ShortcutsTest : public QObject
 {
     Q_OBJECT
@@ -24,9 +74,32 @@ private Q_SLOTS:
     void initTestCase();
     void testShortcuts_data();
     void testShortcuts();
+    void testModifierOnlyShortcutsActive();
     void testSerialization();
+    void testContestedKeys();
+    void testRepeat();
+    void testBatch();
+    void testRegistrySnapshot();
+    void testChangesSince();
+    void testHandles();
+    void testSubscribe();
+    void testSubscribeOwner_data();
+    void testSubscribeOwner();
+    void testPeerConnection();
+    void testEventChannel();
+
+public Q_SLOTS:
+    void shortcutEvent(uint handle, uint state, qlonglong timestamp);
 
 private:
+    //! Registers @p actionId with @p keys, present and grabbed, returns its handle
+    uint registerAction(const QStringList &actionId, const QList<QKeySequence> &keys);
+    //! The exported object of the component @p componentUnique
+    Component *componentObject(const QString &componentUnique);
+    //! Presses and releases @p key, returns whether the press was handled
+    bool pressAndRelease(int key);
+
+    QList<std::pair<uint, uint>> m_shortcutEvents;
     std::unique_ptr<KGlobalAccelD> m_globalacceld;
     KGlobalAccelImpl *m_interface; // implementation of KGlobalAccelInterface * for this test
     KGlobalAccel *m_globalaccel;
@@ -44,6 +117,26 @@ void ShortcutsTest::initTestCase()
     QVERIFY(m_globalaccel);
 }
 
+uint ShortcutsTest::registerAction(const QStringList &actionId, const QList<QKeySequence> &keys)
+{
+    m_globalacceld->doRegister(actionId);
+    m_globalacceld->setShortcutKeys(actionId, keys, KGlobalAccelD::SetPresent | KGlobalAccelD::NoAutoloading);
+    return m_globalacceld->actionHandle(actionId);
+}
+
+Component *ShortcutsTest::componentObject(const QString &componentUnique)
+{
+    const QDBusObjectPath path = m_globalacceld->getComponent(componentUnique);
+    return qobject_cast<Component *>(QDBusConnection::sessionBus().objectRegisteredAt(path.path()));
+}
+
+bool ShortcutsTest::pressAndRelease(int key)
+{
+    const bool handled = m_interface->checkKeyEvent(key, ShortcutKeyState::Pressed);
+    m_interface->checkKeyEvent(key, ShortcutKeyState::Released);
+    return handled;
+}
+
 typedef std::pair<QEvent::Type, int> Event;
 typedef QList<Event> Events;
 
@@ -184,6 +277,24 @@ void ShortcutsTest::testShortcuts()
     m_globalaccel->removeAllShortcuts(action.get());
 }
 
+void ShortcutsTest::testModifierOnlyShortcutsActive()
+{
+    // Modifier-only shortcuts are not grabbed, the platform watches the input for them only while there are any
+    auto action = std::make_unique<QAction>();
+    action->setObjectName(QStringLiteral("ActionForModifierOnlyTest"));
+    QVERIFY(KGlobalAccel::setGlobalShortcut(action.get(), QKeySequence(Qt::ControlModifier | Qt::Key_P)));
+    QVERIFY(!m_interface->modifierOnlyShortcutsActive());
+
+    auto modifierOnlyAction = std::make_unique<QAction>();
+    modifierOnlyAction->setObjectName(QStringLiteral("ModifierOnlyActionForModifierOnlyTest"));
+    QVERIFY(KGlobalAccel::setGlobalShortcut(modifierOnlyAction.get(), QKeySequence(Qt::ControlModifier)));
+    QVERIFY(m_interface->modifierOnlyShortcutsActive());
+
+    m_globalaccel->removeAllShortcuts(modifierOnlyAction.get());
+    QTRY_VERIFY(!m_interface->modifierOnlyShortcutsActive());
+    m_globalaccel->removeAllShortcuts(action.get());
+}
+
 void ShortcutsTest::testSerialization()
 {
     QCOMPARE(Component::keysFromString(QLatin1String("none")), QList<QKeySequence>());
@@ -199,6 +310,417 @@ void ShortcutsTest::testSerialization()
     QCOMPARE(Component::stringFromKeys(QList<QKeySequence>() << QKeySequence() << QKeySequence(Qt::CTRL | Qt::Key_P) << QKeySequence()), QLatin1String("\tCtrl+P\t"));
 }
 
+void ShortcutsTest::testContestedKeys()
+{
+    const QKeySequence contested(Qt::ControlModifier | Qt::AltModifier | Qt::Key_Q);
+    m_interface->setContestedKeys({contested[0].toCombined()});
+
+    auto action = std::make_unique<QAction>();
+    action->setObjectName(QStringLiteral("ActionForContestedTest"));
+    KGlobalAccel::setGlobalShortcut(action.get(), contested);
+    QCOMPARE(m_globalacceld->contestedKeys(), QList<QKeySequence>{contested});
+
+    // Only keys which are wanted count
+    m_globalaccel->removeAllShortcuts(action.get());
+    QCOMPARE(m_globalacceld->contestedKeys(), QList<QKeySequence>());
+    m_interface->setContestedKeys({});
+}
+
+void ShortcutsTest::testRepeat()
+{
+    const QKeySequence shortcut(Qt::ControlModifier | Qt::Key_R);
+    auto action = std::make_unique<QAction>();
+    action->setObjectName(QStringLiteral("ActionForRepeatTest"));
+    QVERIFY(KGlobalAccel::setGlobalShortcut(action.get(), shortcut));
+
+    Component *component = componentObject(QCoreApplication::applicationName());
+    QVERIFY(component);
+    QSignalSpy pressed(component, &Component::globalShortcutPressed);
+    QSignalSpy repeated(component, &Component::globalShortcutRepeated);
+
+    const int key = shortcut[0].toCombined();
+    QVERIFY(m_interface->checkKeyEvent(key, ShortcutKeyState::Pressed));
+    QCOMPARE(pressed.count(), 1);
+
+    // Repeats which come too fast are swallowed
+    QVERIFY(m_interface->checkKeyEvent(key, ShortcutKeyState::Repeated));
+    QVERIFY(m_interface->checkKeyEvent(key, ShortcutKeyState::Repeated));
+    QCOMPARE(repeated.count(), 1);
+    QTest::qWait(100);
+    QVERIFY(m_interface->checkKeyEvent(key, ShortcutKeyState::Repeated));
+    QCOMPARE(repeated.count(), 2);
+    QCOMPARE(pressed.count(), 1);
+
+    m_interface->checkKeyEvent(key, ShortcutKeyState::Released);
+    m_globalaccel->removeAllShortcuts(action.get());
+}
+
+void ShortcutsTest::testBatch()
+{
+    const QString componentUnique = QStringLiteral("batchtest");
+    QList<QStringList> actionIds;
+    QList<QList<QKeySequence>> keys;
+    for (int i = 0; i < 3; ++i) {
+        actionIds.append({componentUnique, QStringLiteral("action%1").arg(i), QStringLiteral("Batch Test"), QStringLiteral("Action %1").arg(i)});
+        keys.append({QKeySequence(QKeyCombination(Qt::ControlModifier | Qt::AltModifier, Qt::Key(Qt::Key_1 + i)))});
+    }
+
+    m_globalacceld->doRegisterBatch(actionIds);
+    const QList<uint> flags(actionIds.size(), KGlobalAccelD::SetPresent | KGlobalAccelD::NoAutoloading);
+    QCOMPARE(m_globalacceld->setShortcutKeysBatch(actionIds, keys, flags), keys);
+    for (qsizetype i = 0; i < actionIds.size(); ++i) {
+        QCOMPARE(m_globalacceld->shortcutKeys(actionIds[i]), keys[i]);
+    }
+
+    const int key = keys[1][0][0].toCombined();
+    QVERIFY(pressAndRelease(key));
+
+    // The shortcuts stay for conflict checks but don't trigger anymore
+    m_globalacceld->setComponentInactive(componentUnique);
+    QVERIFY(!pressAndRelease(key));
+    QVERIFY(!m_globalacceld->globalShortcutAvailable(keys[1][0], QStringLiteral("othercomponent")));
+
+    for (const QStringList &actionId : std::as_const(actionIds)) {
+        m_globalacceld->unregister(componentUnique, actionId[KGlobalAccel::ActionUnique]);
+    }
+}
+
+void ShortcutsTest::testRegistrySnapshot()
+{
+    const QString componentUnique = QStringLiteral("snapshottest");
+    QList<QStringList> actionIds;
+    for (int i = 0; i < 3; ++i) {
+        actionIds.append({componentUnique, QStringLiteral("action%1").arg(i), QStringLiteral("Snapshot Test"), QStringLiteral("Action %1").arg(i)});
+    }
+    m_globalacceld->doRegisterBatch(actionIds);
+
+    auto actionsOf = [&componentUnique](const QList<KGlobalShortcutInfo> &infos) {
+        QStringList actions;
+        for (const KGlobalShortcutInfo &info : infos) {
+            if (info.componentUniqueName() == componentUnique) {
+                actions.append(info.uniqueName());
+            }
+        }
+        return actions;
+    };
+
+    const QList<KGlobalShortcutInfo> all = m_globalacceld->registrySnapshot(0, 0);
+    QCOMPARE(actionsOf(all).size(), 3);
+
+    // Reading in pages gives the same shortcuts in the same order
+    QList<KGlobalShortcutInfo> paged;
+    for (uint first = 0;; first += 2) {
+        const QList<KGlobalShortcutInfo> page = m_globalacceld->registrySnapshot(first, 2);
+        QVERIFY(page.size() <= 2);
+        if (page.isEmpty()) {
+            break;
+        }
+        paged.append(page);
+    }
+    QCOMPARE(paged.size(), all.size());
+    QCOMPARE(actionsOf(paged), actionsOf(all));
+
+    // Changed keys show up in the next snapshot
+    const QList<QKeySequence> keys{QKeySequence(Qt::ControlModifier | Qt::AltModifier | Qt::Key_F9)};
+    m_globalacceld->setForeignShortcutKeys(actionIds[0], keys);
+    bool found = false;
+    for (const KGlobalShortcutInfo &info : m_globalacceld->registrySnapshot(0, 0)) {
+        if (info.componentUniqueName() == componentUnique && info.uniqueName() == actionIds[0][KGlobalAccel::ActionUnique]) {
+            QCOMPARE(info.keys(), keys);
+            found = true;
+        }
+    }
+    QVERIFY(found);
+
+    for (const QStringList &actionId : std::as_const(actionIds)) {
+        m_globalacceld->unregister(componentUnique, actionId[KGlobalAccel::ActionUnique]);
+    }
+    QVERIFY(actionsOf(m_globalacceld->registrySnapshot(0, 0)).isEmpty());
+}
+
+void ShortcutsTest::testChangesSince()
+{
+    QSignalSpy generationSpy(m_globalacceld.get(), &KGlobalAccelD::generationChanged);
+    const qulonglong start = m_globalacceld->generation();
+
+    const QString componentUnique = QStringLiteral("changestest");
+    const QStringList actionId{componentUnique, QStringLiteral("action"), QStringLiteral("Changes Test"), QStringLiteral("Action")};
+    m_globalacceld->doRegister(actionId);
+    const QList<QKeySequence> keys{QKeySequence(Qt::ControlModifier | Qt::AltModifier | Qt::Key_F10)};
+    m_globalacceld->setShortcutKeys(actionId, keys, KGlobalAccelD::NoAutoloading);
+
+    // All changes are reported once
+    QVERIFY(generationSpy.wait());
+    QCOMPARE(generationSpy.count(), 1);
+    QVERIFY(generationSpy.first().first().toULongLong() > start);
+
+    QStringList components;
+    qulonglong current = 0;
+    bool fullResync = true;
+    QList<KGlobalShortcutInfo> shortcuts = m_globalacceld->changesSince(start, components, current, fullResync);
+    QVERIFY(!fullResync);
+    QCOMPARE(current, m_globalacceld->generation());
+    QCOMPARE(components, QStringList{componentUnique});
+    QCOMPARE(shortcuts.size(), 1);
+    QCOMPARE(shortcuts.first().uniqueName(), actionId[KGlobalAccel::ActionUnique]);
+    QCOMPARE(shortcuts.first().keys(), keys);
+
+    // Nothing changed since
+    components.clear();
+    QVERIFY(m_globalacceld->changesSince(current, components, current, fullResync).isEmpty());
+    QVERIFY(!fullResync);
+    QVERIFY(components.isEmpty());
+
+    // Removed components are reported without shortcuts
+    const qulonglong beforeRemoval = current;
+    m_globalacceld->unregister(componentUnique, actionId[KGlobalAccel::ActionUnique]);
+    shortcuts = m_globalacceld->changesSince(beforeRemoval, components, current, fullResync);
+    QVERIFY(!fullResync);
+    QCOMPARE(components, QStringList{componentUnique});
+    QVERIFY(shortcuts.isEmpty());
+
+    // Generations which are unknown need everything to be read again
+    components.clear();
+    m_globalacceld->changesSince(0, components, current, fullResync);
+    QVERIFY(fullResync);
+    m_globalacceld->changesSince(current + 1, components, current, fullResync);
+    QVERIFY(fullResync);
+    // The same count of changes in another run
+    m_globalacceld->changesSince(current - (quint64(1) << 32), components, current, fullResync);
+    QVERIFY(fullResync);
+}
+
+void ShortcutsTest::testHandles()
+{
+    const QStringList actionId{QStringLiteral("handletest"), QStringLiteral("action"), QStringLiteral("Handle Test"), QStringLiteral("Action")};
+    QCOMPARE(m_globalacceld->actionHandle(actionId), 0u);
+
+    m_globalacceld->doRegister(actionId);
+    const uint handle = m_globalacceld->actionHandle(actionId);
+    QVERIFY(handle != 0);
+    QCOMPARE(m_globalacceld->actionHandle(actionId), handle);
+
+    const QList<QKeySequence> keys{QKeySequence(Qt::ControlModifier | Qt::AltModifier | Qt::Key_F11)};
+    QCOMPARE(m_globalacceld->setShortcutKeysByHandle(handle, keys, KGlobalAccelD::SetPresent | KGlobalAccelD::NoAutoloading), keys);
+    QCOMPARE(m_globalacceld->shortcutKeysByHandle(handle), keys);
+    QCOMPARE(m_globalacceld->shortcutKeys(actionId), keys);
+
+    const int key = keys[0][0].toCombined();
+    QVERIFY(pressAndRelease(key));
+    m_globalacceld->setInactiveByHandle(handle);
+    QVERIFY(!pressAndRelease(key));
+
+    // The handle refers to nothing without the action, and to it again once it is registered anew
+    QVERIFY(m_globalacceld->unregisterByHandle(handle));
+    QVERIFY(!m_globalacceld->unregisterByHandle(handle));
+    QVERIFY(m_globalacceld->shortcutKeysByHandle(handle).isEmpty());
+    m_globalacceld->doRegister(actionId);
+    QCOMPARE(m_globalacceld->actionHandle(actionId), handle);
+
+    // Other actions get other handles
+    const QStringList otherActionId{actionId[0], QStringLiteral("other"), actionId[2], QStringLiteral("Other")};
+    m_globalacceld->doRegister(otherActionId);
+    const uint otherHandle = m_globalacceld->actionHandle(otherActionId);
+    QVERIFY(otherHandle != 0);
+    QVERIFY(otherHandle != handle);
+    QVERIFY(m_globalacceld->unregisterByHandle(otherHandle));
+    QVERIFY(m_globalacceld->unregisterByHandle(handle));
+}
+
+void ShortcutsTest::shortcutEvent(uint handle, uint state, qlonglong timestamp)
+{
+    Q_UNUSED(timestamp)
+    m_shortcutEvents.append({handle, state});
+}
+
+void ShortcutsTest::testSubscribe()
+{
+    const QStringList actionId{QCoreApplication::applicationName(), QStringLiteral("subscribed"), QString(), QStringLiteral("Subscribed")};
+    const QList<QKeySequence> keys{QKeySequence(Qt::ControlModifier | Qt::AltModifier | Qt::Key_F12)};
+    const uint handle = registerAction(actionId, keys);
+    QVERIFY(handle != 0);
+
+    Component *component = componentObject(QCoreApplication::applicationName());
+    QVERIFY(component);
+    QSignalSpy pressedSpy(component, &Component::globalShortcutPressed);
+
+    // The subscription is made by the registry, calls from within the process have no bus name
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    QVERIFY(bus.connect(QString(), QStringLiteral("/kglobalaccel"), QStringLiteral("org.kde.KGlobalAccel"), QStringLiteral("shortcutEvent"), this, SLOT(shortcutEvent(uint, uint, qlonglong))));
+    component->_registry->addClient(component, bus, bus.baseService());
+    component->_registry->subscribe(handle, bus, bus.baseService());
+
+    const int key = keys[0][0].toCombined();
+    QVERIFY(pressAndRelease(key));
+    QTRY_COMPARE(m_shortcutEvents.size(), 2);
+    QCOMPARE(m_shortcutEvents[0], std::make_pair(handle, uint(ShortcutKeyState::Pressed)));
+    QCOMPARE(m_shortcutEvents[1], std::make_pair(handle, uint(ShortcutKeyState::Released)));
+    QCOMPARE(pressedSpy.count(), 0);
+
+    // Another client of the component relies on its signals
+    const Component::Client otherClient{bus.name(), QStringLiteral(":1.other")};
+    component->addClient(otherClient);
+    QVERIFY(pressAndRelease(key));
+    QCOMPARE(pressedSpy.count(), 1);
+    component->removeClient(otherClient);
+
+    component->_registry->unsubscribe(handle, bus, bus.baseService());
+    QVERIFY(pressAndRelease(key));
+    QCOMPARE(pressedSpy.count(), 2);
+
+    bus.disconnect(QString(), QStringLiteral("/kglobalaccel"), QStringLiteral("org.kde.KGlobalAccel"), QStringLiteral("shortcutEvent"), this, SLOT(shortcutEvent(uint, uint, qlonglong)));
+    m_globalacceld->unregisterByHandle(handle);
+}
+
+void ShortcutsTest::testSubscribeOwner_data()
+{
+    QTest::addColumn<bool>("channel");
+
+    QTest::newRow("subscribe") << false;
+    QTest::newRow("channel") << true;
+}
+
+void ShortcutsTest::testSubscribeOwner()
+{
+    QFETCH(bool, channel);
+
+    BusClient owner(QStringLiteral("ownertest"));
+    auto other = std::make_unique<BusClient>(QStringLiteral("othertest"));
+    QVERIFY(owner.connection().isConnected());
+    QVERIFY(other->connection().isConnected());
+    if (channel && !owner.connection().connectionCapabilities().testFlag(QDBusConnection::UnixFileDescriptorPassing)) {
+        QSKIP("The bus can't pass file descriptors");
+    }
+
+    // The other client registers the component after the owner did, which doesn't take it over
+    const QString componentUnique = QStringLiteral("ownertest_") + QLatin1String(QTest::currentDataTag());
+    const QStringList actionId{componentUnique, QStringLiteral("owned"), QStringLiteral("Owner Test"), QStringLiteral("Owned")};
+    QCOMPARE(owner.call(QStringLiteral("doRegister"), {actionId}).type(), QDBusMessage::ReplyMessage);
+    QCOMPARE(other->call(QStringLiteral("doRegister"), {actionId}).type(), QDBusMessage::ReplyMessage);
+    const uint handle = m_globalacceld->actionHandle(actionId);
+    QVERIFY(handle != 0);
+
+    const QString method = channel ? QStringLiteral("openEventChannel") : QStringLiteral("subscribe");
+    const QVariantList arguments{channel ? QVariant::fromValue(QList<uint>{handle}) : QVariant(handle)};
+    QCOMPARE(other->call(method, arguments).errorName(), QDBusError::errorString(QDBusError::AccessDenied));
+    const QDBusMessage reply = owner.call(method, arguments);
+    QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+    if (channel) {
+        if (!reply.arguments().at(0).toBool()) {
+            QSKIP("No memfd or eventfd");
+        }
+        QVERIFY(reply.arguments().at(1).value<QDBusUnixFileDescriptor>().isValid());
+        QVERIFY(reply.arguments().at(2).value<QDBusUnixFileDescriptor>().isValid());
+    }
+
+    // The component emits its signals for the other client until it leaves
+    Component *component = componentObject(componentUnique);
+    QVERIFY(component);
+    const GlobalShortcut *shortcut = component->_registry->shortcutByHandle(handle);
+    QVERIFY(shortcut);
+    QVERIFY(!component->_registry->sendToSubscribers(*shortcut, ShortcutKeyState::Pressed, 0));
+    other.reset();
+    QTRY_VERIFY(component->_registry->sendToSubscribers(*shortcut, ShortcutKeyState::Pressed, 0));
+
+    m_globalacceld->unregisterByHandle(handle);
+}
+
+void ShortcutsTest::testPeerConnection()
+{
+    const QString address = m_globalacceld->peerAddress();
+    QVERIFY(!address.isEmpty());
+    QCOMPARE(m_globalacceld->peerAddress(), address);
+
+    QDBusConnection peer = QDBusConnection::connectToPeer(address, QStringLiteral("peertest"));
+    QVERIFY2(peer.isConnected(), qPrintable(peer.lastError().message()));
+
+    // Asynchronous calls, the daemon answers from the event loop of this thread
+    QDBusPendingReply<QList<QStringList>> components =
+        peer.asyncCall(QDBusMessage::createMethodCall(QString(), QStringLiteral("/kglobalaccel"), QStringLiteral("org.kde.KGlobalAccel"), QStringLiteral("allMainComponents")));
+    QTRY_VERIFY(components.isFinished());
+    QVERIFY2(!components.isError(), qPrintable(components.error().message()));
+    QCOMPARE(components.value(), m_globalacceld->allMainComponents());
+
+    // The components are there as well
+    const QDBusObjectPath path = m_globalacceld->getComponent(QCoreApplication::applicationName());
+    QDBusPendingReply<QStringList> names = peer.asyncCall(
+        QDBusMessage::createMethodCall(QString(), path.path(), QStringLiteral("org.kde.kglobalaccel.Component"), QStringLiteral("getShortcutContexts")));
+    QTRY_VERIFY(names.isFinished());
+    QVERIFY2(!names.isError(), qPrintable(names.error().message()));
+    QVERIFY(names.value().contains(QStringLiteral("default")));
+
+    QDBusConnection::disconnectFromPeer(peer.name());
+}
+
+void ShortcutsTest::testEventChannel()
+{
+#ifdef Q_OS_LINUX
+    const QStringList actionId{QCoreApplication::applicationName(), QStringLiteral("channel"), QString(), QStringLiteral("Channel")};
+    const QList<QKeySequence> keys{QKeySequence(Qt::ControlModifier | Qt::ShiftModifier | Qt::Key_F1)};
+    const uint handle = registerAction(actionId, keys);
+    QVERIFY(handle != 0);
+
+    std::unique_ptr<ShortcutEventChannel> channel = ShortcutEventChannel::create();
+    if (!channel) {
+        QSKIP("No memfd or eventfd");
+    }
+    // Like a client, with its own descriptors
+    const int memoryFd = dup(channel->memoryFd());
+    const int notifierFd = dup(channel->notifierFd());
+    auto cleanup = qScopeGuard([&] {
+        close(memoryFd);
+        close(notifierFd);
+    });
+
+    const size_t size = sizeof(ShortcutEventChannel::Header) + ShortcutEventChannel::s_capacity * sizeof(ShortcutEventChannel::Record);
+#ifdef F_SEAL_FUTURE_WRITE
+    // The client can't write to the memory
+    QCOMPARE(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0), MAP_FAILED);
+#endif
+    void *memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, memoryFd, 0);
+    QVERIFY(memory != MAP_FAILED);
+    auto unmap = qScopeGuard([&] {
+        munmap(memory, size);
+    });
+    const auto *header = static_cast<const ShortcutEventChannel::Header *>(memory);
+    const auto *records = reinterpret_cast<const ShortcutEventChannel::Record *>(header + 1);
+    QCOMPARE(header->magic, ShortcutEventChannel::s_magic);
+    QCOMPARE(header->capacity, ShortcutEventChannel::s_capacity);
+    QCOMPARE(header->writeIndex.load(), quint64(0));
+
+    Component *component = componentObject(QCoreApplication::applicationName());
+    QVERIFY(component);
+    QSignalSpy pressedSpy(component, &Component::globalShortcutPressed);
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    component->_registry->addClient(component, bus, bus.baseService());
+    component->_registry->addEventChannel(bus, bus.baseService(), {handle}, std::move(channel));
+
+    const int key = keys[0][0].toCombined();
+    QVERIFY(pressAndRelease(key));
+
+    quint64 notifications = 0;
+    QCOMPARE(read(notifierFd, &notifications, sizeof(notifications)), ssize_t(sizeof(notifications)));
+    QCOMPARE(notifications, quint64(2));
+    QCOMPARE(header->writeIndex.load(), quint64(2));
+    QCOMPARE(records[0].handle, handle);
+    QCOMPARE(records[0].state, quint32(ShortcutKeyState::Pressed));
+    QCOMPARE(records[1].handle, handle);
+    QCOMPARE(records[1].state, quint32(ShortcutKeyState::Released));
+    QCOMPARE(pressedSpy.count(), 0);
+
+    // Without the channel the component emits its signals again
+    component->_registry->removeEventChannel(bus, bus.baseService());
+    QVERIFY(pressAndRelease(key));
+    QCOMPARE(pressedSpy.count(), 1);
+    QCOMPARE(header->writeIndex.load(), quint64(2));
+
+    m_globalacceld->unregisterByHandle(handle);
+#else
+    QSKIP("Event channels need Linux");
+#endif
+}
+
 QTEST_MAIN(ShortcutsTest)
 
 #include "shortcutstest.moc"
@@ -0,0 +1,516 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+/** @file
+ * Benchmarks for the xcb plugin.
+ *
+ * Starts an Xvfb of its own, unless --display is given, loads the xcb plugin
+ * and reports the results as a single JSON object. --benchmark picks what is
+ * measured:
+ *
+ * - typing: types through XTest while a modifier-only shortcut is registered
+ *   and reports the CPU time spent by this process. Run it once for every
+ *   backend, and with --idle for the cost of typing alone.
+ * - grabs: grabbing and releasing N keys, in one batch and one by one, the
+ *   handling of keymap changes, for a new keymap and for one seen before, and
+ *   the latency from a key press injected with XTest to globalShortcutPressed.
+ *
+ *   ./x11inputbenchmark --backend xrecord
+ *   ./x11inputbenchmark --backend xinput2
+ *   ./x11inputbenchmark --idle
+ *   ./x11inputbenchmark --benchmark grabs --keys 200 --presses 500 > results.json
+ */
+
+#include "component.h"
+#include "globalshortcut.h"
+#include "globalshortcutsregistry.h"
+#include "kglobalaccel_interface.h"
+
+#include <KConfig>
+#include <KConfigGroup>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDeadlineTimer>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+
+#include <X11/keysym.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <xcb/xcb.h>
+#include <xcb/xcb_keysyms.h>
+#include <xcb/xtest.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+Q_IMPORT_PLUGIN(KGlobalAccelImpl)
+
+extern char **environ;
+
+namespace
+{
+/**
+ * Runs Xvfb on the first free display for as long as it lives. Started
+ * before the QApplication, so that the platform plugin connects to it.
+ */
+class Xvfb
+{
+public:
+    bool start()
+    {
+        int displayPipe[2];
+        if (pipe(displayPipe) != 0) {
+            return false;
+        }
+
+        // Xvfb picks the display itself and writes its number to the fd
+        const std::string fd = std::to_string(displayPipe[1]);
+        const char *argv[] = {"Xvfb", "-displayfd", fd.c_str(), "-nolisten", "tcp", "-screen", "0", "1024x768x24", nullptr};
+        const int error = posix_spawnp(&m_pid, "Xvfb", nullptr, nullptr, const_cast<char **>(argv), environ);
+        close(displayPipe[1]);
+        if (error != 0) {
+            close(displayPipe[0]);
+            m_pid = 0;
+            return false;
+        }
+
+        char display[16] = {};
+        const ssize_t count = read(displayPipe[0], display, sizeof(display) - 1);
+        close(displayPipe[0]);
+        if (count <= 0) {
+            return false;
+        }
+        m_display = ":" + QByteArray(display, count).trimmed();
+        return true;
+    }
+
+    ~Xvfb()
+    {
+        if (m_pid) {
+            kill(m_pid, SIGTERM);
+            waitpid(m_pid, nullptr, 0);
+        }
+    }
+
+    QByteArray display() const
+    {
+        return m_display;
+    }
+
+private:
+    pid_t m_pid = 0;
+    QByteArray m_display;
+};
+
+double milliseconds(const timeval &time)
+{
+    return time.tv_sec * 1000.0 + time.tv_usec / 1000.0;
+}
+
+double cpuMilliseconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return milliseconds(usage.ru_utime) + milliseconds(usage.ru_stime);
+}
+
+QJsonObject summarize(QList<double> samples)
+{
+    if (samples.isEmpty()) {
+        return {};
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        return samples[std::min<qsizetype>(samples.size() - 1, qsizetype(p * samples.size()))];
+    };
+    return {
+        {QStringLiteral("samples"), samples.size()},
+        {QStringLiteral("min"), samples.constFirst()},
+        {QStringLiteral("median"), percentile(0.5)},
+        {QStringLiteral("p95"), percentile(0.95)},
+        {QStringLiteral("max"), samples.constLast()},
+    };
+}
+
+//! Distinct key combinations which are not used by anything else in the benchmark
+QList<int> benchmarkKeys(int count)
+{
+    QList<int> baseKeys;
+    for (int key = Qt::Key_A; key <= Qt::Key_Z; ++key) {
+        baseKeys.append(key);
+    }
+    for (int key = Qt::Key_0; key <= Qt::Key_9; ++key) {
+        baseKeys.append(key);
+    }
+    for (int key = Qt::Key_F1; key <= Qt::Key_F12; ++key) {
+        baseKeys.append(key);
+    }
+    const QList<int> modifiers{
+        Qt::ControlModifier | Qt::AltModifier,
+        Qt::ControlModifier | Qt::AltModifier | Qt::ShiftModifier,
+        Qt::MetaModifier | Qt::AltModifier,
+        Qt::MetaModifier | Qt::ControlModifier | Qt::ShiftModifier,
+    };
+
+    QList<int> keys;
+    for (int modifier : modifiers) {
+        for (int key : baseKeys) {
+            if (keys.size() == count) {
+                return keys;
+            }
+            keys.append(modifier | key);
+        }
+    }
+    return keys;
+}
+
+xcb_keycode_t keyCodeFor(xcb_key_symbols_t *keySymbols, xcb_keysym_t sym)
+{
+    xcb_keycode_t *keyCodes = xcb_key_symbols_get_keycode(keySymbols, sym);
+    if (!keyCodes) {
+        return 0;
+    }
+    const xcb_keycode_t keyCode = keyCodes[0];
+    free(keyCodes);
+    return keyCode;
+}
+
+//! A client of its own, like the applications the user types into
+class Client
+{
+public:
+    explicit Client(const QByteArray &display)
+        : m_connection(xcb_connect(display.constData(), nullptr))
+    {
+    }
+
+    ~Client()
+    {
+        xcb_disconnect(m_connection);
+    }
+
+    bool isValid() const
+    {
+        return !xcb_connection_has_error(m_connection);
+    }
+
+    xcb_connection_t *connection() const
+    {
+        return m_connection;
+    }
+
+    xcb_keycode_t keyCode(xcb_keysym_t sym) const
+    {
+        xcb_key_symbols_t *keySymbols = xcb_key_symbols_alloc(m_connection);
+        const xcb_keycode_t keyCode = keyCodeFor(keySymbols, sym);
+        xcb_key_symbols_free(keySymbols);
+        return keyCode;
+    }
+
+    void fakeKey(uint8_t type, xcb_keycode_t keyCode) const
+    {
+        xcb_test_fake_input(m_connection, type, keyCode, XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+    }
+
+    //! Waits until the X server handled everything sent so far, and lets us handle the resulting events
+    void sync() const
+    {
+        free(xcb_get_input_focus_reply(m_connection, xcb_get_input_focus(m_connection), nullptr));
+        QCoreApplication::processEvents();
+    }
+
+private:
+    xcb_connection_t *m_connection;
+};
+
+//! Lets the daemon handle everything, waiting doesn't cost CPU time
+void settle(int msecs)
+{
+    QDeadlineTimer deadline(msecs);
+    while (!deadline.hasExpired()) {
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, deadline.remainingTime());
+    }
+}
+
+QJsonObject benchmarkTyping(GlobalShortcutsRegistry &registry, const Client &client, const QString &backend, int keys, bool idle)
+{
+    if (!idle) {
+        GlobalShortcut *shortcut = registry.getComponent(QStringLiteral("org.kde.benchmark"))->getShortcutByName(QStringLiteral("action"));
+        shortcut->setKeys({QKeySequence(Qt::MetaModifier)});
+        shortcut->setIsPresent(true);
+    }
+
+    const xcb_keycode_t keyA = client.keyCode(XK_a);
+    const xcb_keycode_t keyShift = client.keyCode(XK_Shift_L);
+    if (!keyA || !keyShift) {
+        fprintf(stderr, "Cannot find the keycodes to type\n");
+        return {};
+    }
+    client.sync();
+
+    rusage before;
+    getrusage(RUSAGE_SELF, &before);
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    for (int i = 0; i < keys; ++i) {
+        // Every eighth key is typed with Shift, which goes through the whole state machine
+        const bool withShift = i % 8 == 0;
+        if (withShift) {
+            client.fakeKey(XCB_KEY_PRESS, keyShift);
+        }
+        client.fakeKey(XCB_KEY_PRESS, keyA);
+        client.fakeKey(XCB_KEY_RELEASE, keyA);
+        if (withShift) {
+            client.fakeKey(XCB_KEY_RELEASE, keyShift);
+        }
+        if (i % 100 == 99) {
+            client.sync();
+        }
+    }
+    client.sync();
+    const qint64 typingMs = elapsed.elapsed();
+
+    // Give the daemon the time to catch up
+    settle(500);
+
+    rusage after;
+    getrusage(RUSAGE_SELF, &after);
+
+    return {
+        {QStringLiteral("backend"), backend},
+        {QStringLiteral("modifierOnlyShortcut"), !idle},
+        {QStringLiteral("keys"), keys},
+        {QStringLiteral("typingMs"), double(typingMs)},
+        {QStringLiteral("userCpuMs"), milliseconds(after.ru_utime) - milliseconds(before.ru_utime)},
+        {QStringLiteral("systemCpuMs"), milliseconds(after.ru_stime) - milliseconds(before.ru_stime)},
+        {QStringLiteral("contextSwitches"), double(after.ru_nvcsw + after.ru_nivcsw - before.ru_nvcsw - before.ru_nivcsw)},
+    };
+}
+
+QJsonObject benchmarkGrabs(GlobalShortcutsRegistry &registry, const Client &client, const QList<int> &keys, int rounds, int presses)
+{
+    KGlobalAccelInterface *interface = registry.interface();
+
+    // Grabbing and releasing the keys
+    QList<double> batchGrab;
+    QList<double> batchUngrab;
+    QList<double> singleGrab;
+    QList<double> singleUngrab;
+    int grabbed = 0;
+    for (int round = 0; round < rounds; ++round) {
+        QElapsedTimer timer;
+        timer.start();
+        const QList<bool> results = interface->grabKeysBatch(keys, true);
+        batchGrab.append(timer.nsecsElapsed() / 1000000.0);
+        grabbed = results.count(true);
+
+        timer.restart();
+        interface->grabKeysBatch(keys, false);
+        batchUngrab.append(timer.nsecsElapsed() / 1000000.0);
+
+        timer.restart();
+        for (int key : keys) {
+            interface->grabKey(key, true);
+        }
+        singleGrab.append(timer.nsecsElapsed() / 1000000.0);
+
+        timer.restart();
+        for (int key : keys) {
+            interface->grabKey(key, false);
+        }
+        singleUngrab.append(timer.nsecsElapsed() / 1000000.0);
+    }
+
+    // Keymap changes, with the keys grabbed. They differ in a keycode nothing
+    // is bound to. Every round maps it to a keysym it never had before, and
+    // then back to the one it had at the start, which the plugin knows.
+    interface->grabKeysBatch(keys, true);
+    const xcb_setup_t *setup = xcb_get_setup(client.connection());
+    const xcb_keycode_t spareKeyCode = setup->max_keycode;
+    auto changeKeymap = [&client, spareKeyCode](xcb_keysym_t keySym) {
+        xcb_change_keyboard_mapping(client.connection(), 1, spareKeyCode, 1, &keySym);
+        client.sync();
+
+        // The plugin waits a little for more changes before it handles them
+        const double before = cpuMilliseconds();
+        settle(100);
+        return cpuMilliseconds() - before;
+    };
+    const xcb_keysym_t knownKeySym = XK_F35;
+    changeKeymap(knownKeySym);
+    QList<double> newKeymap;
+    QList<double> knownKeymap;
+    for (int round = 0; round < rounds; ++round) {
+        // Unicode keysyms, from the private use area
+        newKeymap.append(changeKeymap(0x100e000 + round));
+        knownKeymap.append(changeKeymap(knownKeySym));
+    }
+    interface->grabKeysBatch(keys, false);
+
+    // Latency of a shortcut press
+    Component *component = registry.getComponent(QStringLiteral("org.kde.benchmark"));
+    GlobalShortcut *shortcut = component->getShortcutByName(QStringLiteral("action"));
+    shortcut->setKeys({QKeySequence(Qt::ControlModifier | Qt::AltModifier | Qt::Key_B)});
+    shortcut->setIsPresent(true);
+    registry.finishPendingTasks();
+
+    const xcb_keycode_t keyControl = client.keyCode(XK_Control_L);
+    const xcb_keycode_t keyAlt = client.keyCode(XK_Alt_L);
+    const xcb_keycode_t keyB = client.keyCode(XK_b);
+    if (!keyControl || !keyAlt || !keyB) {
+        fprintf(stderr, "Cannot find the keycodes to type\n");
+        return {};
+    }
+
+    QElapsedTimer pressTimer;
+    QList<double> latency;
+    int missed = 0;
+    bool triggered = false;
+    QObject::connect(component, &Component::globalShortcutPressed, [&] {
+        latency.append(pressTimer.nsecsElapsed() / 1000.0);
+        triggered = true;
+    });
+
+    client.fakeKey(XCB_KEY_PRESS, keyControl);
+    client.fakeKey(XCB_KEY_PRESS, keyAlt);
+    client.sync();
+    for (int i = 0; i < presses; ++i) {
+        triggered = false;
+        pressTimer.start();
+        client.fakeKey(XCB_KEY_PRESS, keyB);
+        xcb_flush(client.connection());
+
+        QDeadlineTimer deadline(1000);
+        while (!triggered && !deadline.hasExpired()) {
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, deadline.remainingTime());
+        }
+        if (!triggered) {
+            ++missed;
+        }
+
+        // The release comes through the record thread, the next press would look like autorepeat without it
+        client.fakeKey(XCB_KEY_RELEASE, keyB);
+        client.sync();
+        settle(5);
+    }
+    client.fakeKey(XCB_KEY_RELEASE, keyAlt);
+    client.fakeKey(XCB_KEY_RELEASE, keyControl);
+    client.sync();
+
+    return {
+        {QStringLiteral("keys"), keys.size()},
+        {QStringLiteral("grabbedKeys"), grabbed},
+        {QStringLiteral("rounds"), rounds},
+        {QStringLiteral("batchGrabMs"), summarize(batchGrab)},
+        {QStringLiteral("batchUngrabMs"), summarize(batchUngrab)},
+        {QStringLiteral("singleGrabMs"), summarize(singleGrab)},
+        {QStringLiteral("singleUngrabMs"), summarize(singleUngrab)},
+        {QStringLiteral("newKeymapCpuMs"), summarize(newKeymap)},
+        {QStringLiteral("knownKeymapCpuMs"), summarize(knownKeymap)},
+        {QStringLiteral("pressLatencyUs"), summarize(latency)},
+        {QStringLiteral("missedPresses"), missed},
+    };
+}
+}
+
+int main(int argc, char **argv)
+{
+    // The display has to be known before the QApplication connects
+    QByteArray display;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (qstrcmp(argv[i], "--display") == 0) {
+            display = argv[i + 1];
+        }
+    }
+    Xvfb xvfb;
+    if (display.isEmpty()) {
+        if (!xvfb.start()) {
+            fprintf(stderr, "Cannot start Xvfb, pass --display to use a running X server\n");
+            return 1;
+        }
+        display = xvfb.display();
+    }
+    qputenv("DISPLAY", display);
+    qputenv("QT_QPA_PLATFORM", "xcb");
+    qputenv("KGLOBALACCELD_PLATFORM", "xcb");
+    QStandardPaths::setTestModeEnabled(true);
+
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption benchmarkOption(QStringLiteral("benchmark"), QStringLiteral("What to measure, typing or grabs."), QStringLiteral("benchmark"));
+    benchmarkOption.setDefaultValue(QStringLiteral("typing"));
+    QCommandLineOption displayOption(QStringLiteral("display"), QStringLiteral("X server to use instead of starting Xvfb."), QStringLiteral("display"));
+    QCommandLineOption backendOption(QStringLiteral("backend"), QStringLiteral("Input monitor to use, xrecord or xinput2."), QStringLiteral("backend"));
+    backendOption.setDefaultValue(QStringLiteral("xrecord"));
+    QCommandLineOption keysOption(QStringLiteral("keys"), QStringLiteral("Number of keys to type, or to grab, at most 192."), QStringLiteral("count"));
+    QCommandLineOption idleOption(QStringLiteral("idle"), QStringLiteral("Don't register a modifier-only shortcut while typing, so nothing is monitored."));
+    QCommandLineOption roundsOption(QStringLiteral("rounds"), QStringLiteral("How often to grab the keys and to change the keymap."), QStringLiteral("count"));
+    roundsOption.setDefaultValue(QStringLiteral("20"));
+    QCommandLineOption pressesOption(QStringLiteral("presses"), QStringLiteral("Number of shortcut presses to measure the latency of."), QStringLiteral("count"));
+    pressesOption.setDefaultValue(QStringLiteral("200"));
+    parser.addOptions({benchmarkOption, displayOption, backendOption, keysOption, idleOption, roundsOption, pressesOption});
+    parser.process(app);
+
+    const QString benchmark = parser.value(benchmarkOption);
+    if (benchmark != QLatin1String("typing") && benchmark != QLatin1String("grabs")) {
+        fprintf(stderr, "Unknown benchmark %s\n", qPrintable(benchmark));
+        return 1;
+    }
+    const bool typing = benchmark == QLatin1String("typing");
+    const QString backend = parser.value(backendOption);
+    qputenv("KGLOBALACCELD_X11_INPUT", backend.toLocal8Bit());
+
+    QDir configDir(QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation));
+    configDir.mkpath(QStringLiteral("."));
+    configDir.remove(QStringLiteral("kglobalshortcutsrc"));
+    {
+        KConfig config(QStringLiteral("kglobalshortcutsrc"), KConfig::SimpleConfig);
+        KConfigGroup group = config.group(QStringLiteral("org.kde.benchmark"));
+        group.writeEntry("_k_friendly_name", QStringLiteral("Benchmark"));
+        group.writeEntry("action", QStringList{QStringLiteral("none"), QStringLiteral("none"), QStringLiteral("Benchmark Action")});
+        config.sync();
+    }
+
+    GlobalShortcutsRegistry registry;
+    registry.loadSettings();
+    registry.finishPendingTasks();
+    if (!registry.interface()) {
+        fprintf(stderr, "Cannot load the xcb plugin\n");
+        return 1;
+    }
+
+    Client client(display);
+    if (!client.isValid()) {
+        fprintf(stderr, "Cannot connect to the X server\n");
+        return 1;
+    }
+
+    QJsonObject result;
+    if (typing) {
+        const int keys = parser.isSet(keysOption) ? parser.value(keysOption).toInt() : 20000;
+        result = benchmarkTyping(registry, client, backend, keys, parser.isSet(idleOption));
+    } else {
+        const int keys = parser.isSet(keysOption) ? parser.value(keysOption).toInt() : 100;
+        result = benchmarkGrabs(registry, client, benchmarkKeys(keys), parser.value(roundsOption).toInt(), parser.value(pressesOption).toInt());
+    }
+    if (result.isEmpty()) {
+        return 1;
+    }
+    fprintf(stdout, "%s\n", QJsonDocument(result).toJson(QJsonDocument::Compact).constData());
+    return 0;
+}
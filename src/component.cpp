@@ -12,6 +12,7 @@
 #include "logging.h"
 #include <config-kglobalaccel.h>
 
+#include <QDBusConnection>
 #include <QKeySequence>
 #include <QStringList>
 
@@ -129,6 +130,7 @@ bool Component::createGlobalShortcutContext(const QString &uniqueName, const QSt
         return false;
     }
     _contexts.insert(uniqueName, new GlobalShortcutContext(uniqueName, friendlyName, this));
+    invalidateSnapshot();
     return true;
 }
 
@@ -182,6 +184,10 @@ void Component::emitGlobalShortcutEvent(const GlobalShortcut &shortcut, Shortcut
         return;
     }
 
+    if (_registry->sendToSubscribers(shortcut, state, timestamp)) {
+        return;
+    }
+
     switch (state) {
     case ShortcutKeyState::Pressed:
         Q_EMIT globalShortcutPressed(shortcut.context()->component()->uniqueName(), shortcut.uniqueName(), timestamp);
@@ -208,6 +214,38 @@ QString Component::friendlyName() const
     return !_friendlyName.isEmpty() ? _friendlyName : _uniqueName;
 }
 
+void Component::addClient(const Client &client)
+{
+    if (!_clients.contains(client)) {
+        _clients.append(client);
+    }
+}
+
+void Component::removeClient(const Client &client)
+{
+    _clients.removeOne(client);
+}
+
+Component::Client Component::owner() const
+{
+    dropDisconnectedClients();
+    return _clients.value(0);
+}
+
+bool Component::isSoleClient(const Client &client) const
+{
+    dropDisconnectedClients();
+    return _clients.size() == 1 && _clients.front() == client;
+}
+
+void Component::dropDisconnectedClients() const
+{
+    // Clients on the session bus are removed when they leave it, peer connections can't be watched
+    _clients.removeIf([](const Client &client) {
+        return !QDBusConnection(client.connectionName).isConnected();
+    });
+}
+
 GlobalShortcut *Component::getShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const
 {
     return _current->getShortcutByKey(key, type);
@@ -305,9 +343,96 @@ void Component::loadSettings(const KConfigGroup &configGroup)
     }
 }
 
+void Component::reloadSettings(const KConfigGroup &configGroup, KeyChanges &keyChanges)
+{
+    if (const QString friendlyName = configGroup.readEntry("_k_friendly_name"); !friendlyName.isEmpty() && friendlyName != _friendlyName) {
+        setFriendlyName(friendlyName);
+    }
+
+    // Contexts in the config file, and the ones we know of which may be gone from it
+    QStringList contexts = configGroup.groupList();
+    contexts.removeAll(QStringLiteral("Friendly Name"));
+    const auto knownContexts = _contexts.keys();
+    for (const QString &context : knownContexts) {
+        if (context != QLatin1String("default") && !contexts.contains(context)) {
+            contexts.append(context);
+        }
+    }
+
+    for (const QString &contextName : std::as_const(contexts)) {
+        const KConfigGroup contextGroup(&configGroup, contextName);
+        if (!_contexts.contains(contextName)) {
+            createGlobalShortcutContext(contextName, contextGroup.readEntry("_k_friendly_name"));
+        }
+        reloadContextSettings(_contexts.value(contextName), contextGroup, keyChanges);
+    }
+
+    reloadContextSettings(_contexts.value(QStringLiteral("default")), configGroup, keyChanges);
+}
+
+void Component::reloadContextSettings(GlobalShortcutContext *context, const KConfigGroup &configGroup, KeyChanges &keyChanges)
+{
+    QStringList names;
+
+    const auto listKeys = configGroup.keyList();
+    for (const QString &confKey : listKeys) {
+        const QStringList entry = configGroup.readEntry(confKey, QStringList());
+        if (entry.size() != 3) {
+            continue;
+        }
+        names.append(confKey);
+
+        GlobalShortcut *shortcut = context->_actionsMap.value(confKey);
+        if (!shortcut) {
+            shortcut = new GlobalShortcut(confKey, entry[2], context, _registry);
+            shortcut->setIsFresh(false);
+        }
+        // Only what changed, every setter invalidates the snapshot
+        if (shortcut->friendlyName() != entry[2]) {
+            shortcut->setFriendlyName(entry[2]);
+        }
+        if (const QList<QKeySequence> defaultKeys = keysFromString(entry[1]); shortcut->defaultKeys() != defaultKeys) {
+            shortcut->setDefaultKeys(defaultKeys);
+        }
+
+        const QList<QKeySequence> keys = keysFromString(entry[0]);
+        if (shortcut->keys() != keys) {
+            keyChanges.append({shortcut, keys});
+        }
+    }
+
+    const auto shortcuts = context->_actionsMap.values();
+    for (GlobalShortcut *shortcut : shortcuts) {
+        // Fresh and session shortcuts were never written, present ones will be written again
+        if (names.contains(shortcut->uniqueName()) || shortcut->isFresh() || shortcut->isSessionShortcut() || shortcut->isPresent()) {
+            continue;
+        }
+        delete context->takeShortcut(shortcut);
+    }
+}
+
 void Component::setFriendlyName(const QString &name)
 {
     _friendlyName = name;
+    invalidateSnapshot();
+}
+
+const QList<KGlobalShortcutInfo> &Component::snapshot() const
+{
+    if (!_snapshot) {
+        QList<KGlobalShortcutInfo> infos;
+        for (GlobalShortcutContext *context : _contexts) {
+            infos.append(context->allShortcutInfos());
+        }
+        _snapshot = std::move(infos);
+    }
+    return *_snapshot;
+}
+
+void Component::invalidateSnapshot()
+{
+    _snapshot.reset();
+    _registry->noteComponentChanged(_uniqueName);
 }
 
 GlobalShortcutContext *Component::shortcutContext(const QString &contextName)
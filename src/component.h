@@ -18,6 +18,8 @@
 #include <QHash>
 #include <QObject>
 
+#include <optional>
+
 #include "shortcutkeystate.h"
 
 class GlobalShortcut;
@@ -52,6 +54,15 @@ public:
     //! Returns all shortcuts in context @context
     QList<GlobalShortcut *> allShortcuts(const QString &context = QStringLiteral("default")) const;
 
+    /**
+     * Returns the shortcuts of all contexts, as reported by allShortcutInfos().
+     * The list is kept until invalidateSnapshot() is called.
+     */
+    const QList<KGlobalShortcutInfo> &snapshot() const;
+
+    //! Called whenever something in snapshot() changes, advances the generation of the registry
+    void invalidateSnapshot();
+
     //! Creates the new global shortcut context @p context
     bool createGlobalShortcutContext(const QString &context, const QString &friendlyName = QString());
 
@@ -92,11 +103,46 @@ public:
     //! Load the settings from config group @p config
     virtual void loadSettings(const KConfigGroup &config);
 
+    //! Shortcuts whose keys have to be changed, with their new keys
+    using KeyChanges = QList<std::pair<GlobalShortcut *, QList<QKeySequence>>>;
+
+    /**
+     * Update the component from config group @p config, after the config file
+     * was changed by someone else. Shortcuts which are gone from @p config are
+     * removed, unless their application is present.
+     *
+     * Changed keys are not set but added to @p keyChanges, so that the caller
+     * can move keys between shortcuts.
+     */
+    virtual void reloadSettings(const KConfigGroup &config, KeyChanges &keyChanges);
+
     //! Sets the human readable name for this component.
     void setFriendlyName(const QString &);
 
     QString uniqueName() const;
 
+    //! A D-Bus client, by the name of the connection it called on and its bus name there
+    struct Client {
+        QString connectionName;
+        //! Empty on peer connections, those have one client only
+        QString service;
+        bool operator==(const Client &other) const = default;
+    };
+
+    /**
+     * Notes @p client as one which registered the component. The first of
+     * them owns it until it leaves the bus, another client registering the
+     * component later does not take it over. Only the owner can subscribe to
+     * the events of the actions, see KGlobalAccelD::subscribe().
+     */
+    void addClient(const Client &client);
+    //! Forgets @p client once it left the bus, the next client in line becomes the owner
+    void removeClient(const Client &client);
+    //! Empty as long as no client registered the component over D-Bus
+    Client owner() const;
+    //! Whether @p client owns the component and no other client registered it
+    bool isSoleClient(const Client &client) const;
+
     //! Unregister @a shortcut. This will remove its siblings from all contexts
     void unregisterShortcut(const QString &uniqueName);
 
@@ -122,6 +168,8 @@ protected:
     GlobalShortcut *
     registerShortcut(const QString &uniqueName, const QString &friendlyName, const QString &shortcutString, const QString &defaultShortcutString);
 
+    void reloadContextSettings(GlobalShortcutContext *context, const KConfigGroup &config, KeyChanges &keyChanges);
+
     static QString stringFromKeys(const QList<QKeySequence> &keys);
     static QList<QKeySequence> keysFromString(const QString &str);
 
@@ -183,8 +231,15 @@ protected:
 
     GlobalShortcutsRegistry *_registry;
 
+    //! See addClient(), in the order they registered the component. Those of
+    //! peer connections are dropped once the connection is closed.
+    mutable QList<Client> _clients;
+    void dropDisconnectedClients() const;
+
     GlobalShortcutContext *_current;
     QHash<QString, GlobalShortcutContext *> _contexts;
+
+    mutable std::optional<QList<KGlobalShortcutInfo>> _snapshot;
 };
 
 #endif /* #ifndef COMPONENT_H */
@@ -1 +1,4 @@
 #cmakedefine01 HAVE_X11
+#cmakedefine01 HAVE_XCB_XINPUT
+#cmakedefine01 HAVE_MEMFD_CREATE
+#cmakedefine01 HAVE_EVENTFD
@@ -116,6 +116,7 @@ QString GlobalShortcut::friendlyName() const
 void GlobalShortcut::setFriendlyName(const QString &name)
 {
     _friendlyName = name;
+    invalidateSnapshot();
 }
 
 QList<QKeySequence> GlobalShortcut::keys() const
@@ -150,6 +151,7 @@ void GlobalShortcut::setKeys(const QList<QKeySequence> &newKeys)
     };
 
     std::transform(newKeys.cbegin(), newKeys.cend(), std::back_inserter(_keys), getKey);
+    invalidateSnapshot();
 
     if (active) {
         setActive();
@@ -164,6 +166,14 @@ QList<QKeySequence> GlobalShortcut::defaultKeys() const
 void GlobalShortcut::setDefaultKeys(const QList<QKeySequence> &newKeys)
 {
     _defaultKeys = newKeys;
+    invalidateSnapshot();
+}
+
+void GlobalShortcut::invalidateSnapshot()
+{
+    if (_context) {
+        _context->component()->invalidateSnapshot();
+    }
 }
 
 void GlobalShortcut::setActive()
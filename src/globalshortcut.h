@@ -82,6 +82,9 @@ public:
     void unRegister();
 
 private:
+    //! Tells the component that its snapshot is out of date
+    void invalidateSnapshot();
+
     //! means the associated application is present.
     bool _isPresent : 1;
 
@@ -6,6 +6,7 @@
 
 #include "globalshortcutcontext.h"
 
+#include "component.h"
 #include "globalshortcut.h"
 
 #include "kglobalaccel.h"
@@ -28,6 +29,7 @@ GlobalShortcutContext::~GlobalShortcutContext()
 void GlobalShortcutContext::addShortcut(GlobalShortcut *shortcut)
 {
     _actionsMap.insert(shortcut->uniqueName(), shortcut);
+    _component->invalidateSnapshot();
 }
 
 QList<KGlobalShortcutInfo> GlobalShortcutContext::allShortcutInfos() const
@@ -63,33 +65,33 @@ GlobalShortcut *GlobalShortcutContext::getShortcutByKey(const QKeySequence &key,
     for (GlobalShortcut *sc : std::as_const(_actionsMap)) {
         const auto keys = sc->keys();
         for (const QKeySequence &other : keys) {
-            QKeySequence otherMangled = Utils::normalizeSequence(other);
-            switch (type) {
-            case KGlobalAccel::MatchType::Equal:
-                if (otherMangled == keyMangled) {
-                    return sc;
-                }
-                break;
-            case KGlobalAccel::MatchType::Shadows:
-                if (!other.isEmpty() && Utils::contains(keyMangled, otherMangled)) {
-                    return sc;
-                }
-                break;
-            case KGlobalAccel::MatchType::Shadowed:
-                if (!other.isEmpty() && Utils::contains(otherMangled, keyMangled)) {
-                    return sc;
-                }
-                break;
+            if (keyMatches(keyMangled, other, type)) {
+                return sc;
             }
         }
     }
     return nullptr;
 }
 
+bool GlobalShortcutContext::keyMatches(const QKeySequence &keyMangled, const QKeySequence &other, KGlobalAccel::MatchType type)
+{
+    QKeySequence otherMangled = Utils::normalizeSequence(other);
+    switch (type) {
+    case KGlobalAccel::MatchType::Equal:
+        return otherMangled == keyMangled;
+    case KGlobalAccel::MatchType::Shadows:
+        return !other.isEmpty() && Utils::contains(keyMangled, otherMangled);
+    case KGlobalAccel::MatchType::Shadowed:
+        return !other.isEmpty() && Utils::contains(otherMangled, keyMangled);
+    }
+    return false;
+}
+
 GlobalShortcut *GlobalShortcutContext::takeShortcut(GlobalShortcut *shortcut)
 {
     // Try to take the shortcut. Result could be nullptr if the shortcut doesn't
     // belong to this component.
+    _component->invalidateSnapshot();
     return _actionsMap.take(shortcut->uniqueName());
 }
 
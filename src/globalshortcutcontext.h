@@ -51,6 +51,9 @@ public:
     //! Get shortcut for @p key or nullptr
     GlobalShortcut *getShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const;
 
+    //! Checks if @p other matches @p keyMangled, which has to be normalized already
+    static bool keyMatches(const QKeySequence &keyMangled, const QKeySequence &other, KGlobalAccel::MatchType type);
+
     //! Remove @p shortcut from the context. The shortcut is not deleted.
     GlobalShortcut *takeShortcut(GlobalShortcut *shortcut);
 
@@ -24,13 +24,22 @@
 #include <KPluginMetaData>
 #include <KSycoca>
 
+#include <QCryptographicHash>
 #include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDeadlineTimer>
 #include <QDir>
+#include <QFile>
 #include <QGuiApplication>
 #include <QJsonArray>
 #include <QPluginLoader>
+#include <QPointer>
+#include <QRandomGenerator>
 #include <QStandardPaths>
 
+#include <limits>
+#include <tuple>
+
 using namespace Qt::StringLiterals;
 
 static bool checkPlatform(const QJsonObject &metadata, const QString &platformName)
@@ -86,6 +95,33 @@ static QString getConfigFile()
     return qEnvironmentVariableIsSet("KGLOBALACCEL_TEST_MODE") ? QString() : QStringLiteral("kglobalshortcutsrc");
 }
 
+static QStringList serviceDirectories()
+{
+    return QStandardPaths::locateAll(QStandardPaths::GenericDataLocation, QStringLiteral("kglobalaccel"), QStandardPaths::LocateDirectory);
+}
+
+// Where the user drops desktop files, it is not created by us
+static QString userServiceDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QStringLiteral("/kglobalaccel");
+}
+
+static QHash<QString, QString> findServiceFiles()
+{
+    QHash<QString, QString> serviceFiles;
+    const QStringList desktopFiles = KFileUtils::findAllUniqueFiles(serviceDirectories(), {QStringLiteral("*.desktop")});
+    for (const QString &file : desktopFiles) {
+        serviceFiles.insert(QFileInfo(file).fileName(), file);
+    }
+    return serviceFiles;
+}
+
+// Modifier-only shortcuts are not grabbed, they are detected from the input, see keyEvent()
+static bool isModifierOnly(const QKeySequence &key)
+{
+    return key.count() == 1 && (key[0].toCombined() & ~Qt::KeyboardModifierMask) == 0;
+}
+
 void GlobalShortcutsRegistry::migrateKHotkeys()
 {
     KConfig hotkeys(QStringLiteral("khotkeysrc"));
@@ -270,14 +306,21 @@ void GlobalShortcutsRegistry::migrateConfig()
         }
     }
 
-    _config.sync();
+    syncConfig();
 }
 
 GlobalShortcutsRegistry::GlobalShortcutsRegistry()
     : QObject()
     , _manager(loadPlugin(this))
     , _config(getConfigFile(), KConfig::SimpleConfig)
+    , m_epoch(QRandomGenerator::system()->bounded(1u, std::numeric_limits<quint32>::max()))
+    , m_generation(quint64(m_epoch) << 32)
+    , m_changeLogStart(m_generation)
 {
+    if (!_config.name().isEmpty()) {
+        m_configFilePath = QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation) + QLatin1Char('/') + _config.name();
+    }
+
     migrateKHotkeys();
     migrateConfig();
 
@@ -288,10 +331,41 @@ GlobalShortcutsRegistry::GlobalShortcutsRegistry()
     m_refreshServicesTimer.setSingleShot(true);
     m_refreshServicesTimer.setInterval(0);
     connect(&m_refreshServicesTimer, &QTimer::timeout, this, &GlobalShortcutsRegistry::refreshServices);
+
+    m_pendingTasksTimer.setSingleShot(true);
+    m_pendingTasksTimer.setInterval(0);
+    connect(&m_pendingTasksTimer, &QTimer::timeout, this, &GlobalShortcutsRegistry::runPendingTasks);
+
+    m_subscriberWatcher.setConnection(QDBusConnection::sessionBus());
+    m_subscriberWatcher.setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+    connect(&m_subscriberWatcher, &QDBusServiceWatcher::serviceUnregistered, this, &GlobalShortcutsRegistry::subscriberUnregistered);
+
+    m_generationTimer.setSingleShot(true);
+    m_generationTimer.setInterval(0);
+    connect(&m_generationTimer, &QTimer::timeout, this, [this] {
+        Q_EMIT generationChanged(m_generation);
+    });
+
+    watchServiceDirectories();
+
+    // Tools tend to write the file in several steps, wait for them to finish
+    m_reloadConfigTimer.setSingleShot(true);
+    m_reloadConfigTimer.setInterval(100);
+    connect(&m_reloadConfigTimer, &QTimer::timeout, this, &GlobalShortcutsRegistry::reloadConfig);
+    connect(&m_configFileWatcher, &QFileSystemWatcher::fileChanged, &m_reloadConfigTimer, qOverload<>(&QTimer::start));
+
+    m_writeSettingsTimer.setSingleShot(true);
+    m_writeSettingsTimer.setInterval(500);
+    connect(&m_writeSettingsTimer, &QTimer::timeout, this, &GlobalShortcutsRegistry::writeSettings);
+
+    m_configFileHash = configFileHash();
+    watchConfigFile();
 }
 
 GlobalShortcutsRegistry::~GlobalShortcutsRegistry()
 {
+    // Queued writes of the settings must not get lost
+    finishPendingTasks();
     m_components.clear();
 
     if (_manager) {
@@ -299,6 +373,9 @@ GlobalShortcutsRegistry::~GlobalShortcutsRegistry()
         // GlobalShortcutsRegistry::self() doesn't work anymore.
         const auto listKeys = _active_keys.keys();
         for (const QKeySequence &key : listKeys) {
+            if (isModifierOnly(key)) {
+                continue;
+            }
             for (int i = 0; i < key.count(); i++) {
                 _manager->grabKey(key[i].toCombined(), false);
             }
@@ -313,23 +390,66 @@ Component *GlobalShortcutsRegistry::registerComponent(ComponentPtr component)
     m_components.push_back(std::move(component));
     auto *comp = m_components.back().get();
     Q_ASSERT(!comp->dbusPath().path().isEmpty());
-    QDBusConnection conn(QDBusConnection::sessionBus());
-    conn.registerObject(comp->dbusPath().path(), comp, QDBusConnection::ExportScriptableContents);
+    // There is one service component for every application with shortcuts and hardly
+    // anyone looks at them, export those only once their path is handed out
+    if (!qobject_cast<KServiceActionComponent *>(comp)) {
+        exportComponent(comp);
+    }
     return comp;
 }
 
+void GlobalShortcutsRegistry::exportComponent(Component *component) const
+{
+    QDBusConnection conn(QDBusConnection::sessionBus());
+    if (!conn.objectRegisteredAt(component->dbusPath().path())) {
+        conn.registerObject(component->dbusPath().path(), component, QDBusConnection::ExportScriptableContents);
+    }
+
+    for (const QString &name : m_peerConnections) {
+        QDBusConnection peer(name);
+        if (peer.isConnected() && !peer.objectRegisteredAt(component->dbusPath().path())) {
+            peer.registerObject(component->dbusPath().path(), component, QDBusConnection::ExportScriptableContents);
+        }
+    }
+}
+
+void GlobalShortcutsRegistry::addPeerConnection(const QDBusConnection &connection)
+{
+    m_peerConnections.removeIf([](const QString &name) {
+        if (QDBusConnection(name).isConnected()) {
+            return false;
+        }
+        QDBusConnection::disconnectFromPeer(name);
+        return true;
+    });
+    m_peerConnections.append(connection.name());
+
+    // The same components as on the session bus, the others are exported once they are asked for
+    const QDBusConnection bus = QDBusConnection::sessionBus();
+    for (const ComponentPtr &component : m_components) {
+        if (bus.objectRegisteredAt(component->dbusPath().path())) {
+            exportComponent(component.get());
+        }
+    }
+}
+
 void GlobalShortcutsRegistry::activateShortcuts()
 {
+    beginGrabBatch();
     for (auto &component : m_components) {
         component->activateShortcuts();
     }
+    endGrabBatch();
 }
 
-QList<QDBusObjectPath> GlobalShortcutsRegistry::componentsDbusPaths() const
+QList<QDBusObjectPath> GlobalShortcutsRegistry::componentsDbusPaths()
 {
+    promoteDormantComponents();
+
     QList<QDBusObjectPath> dbusPaths;
     dbusPaths.reserve(m_components.size());
-    std::transform(m_components.cbegin(), m_components.cend(), std::back_inserter(dbusPaths), [](const auto &comp) {
+    std::transform(m_components.cbegin(), m_components.cend(), std::back_inserter(dbusPaths), [this](const auto &comp) {
+        exportComponent(comp.get());
         return comp->dbusPath();
     });
     return dbusPaths;
@@ -338,18 +458,25 @@ QList<QDBusObjectPath> GlobalShortcutsRegistry::componentsDbusPaths() const
 QList<QStringList> GlobalShortcutsRegistry::allComponentNames() const
 {
     QList<QStringList> ret;
-    ret.reserve(m_components.size());
+    ret.reserve(m_components.size() + m_dormantComponents.size());
     std::transform(m_components.cbegin(), m_components.cend(), std::back_inserter(ret), [](const auto &component) {
         // A string for each enumerator in KGlobalAccel::actionIdFields
         return QStringList{component->uniqueName(), component->friendlyName(), {}, {}};
     });
+    std::transform(m_dormantComponents.cbegin(), m_dormantComponents.cend(), std::back_inserter(ret), [](const DormantComponent &component) {
+        return QStringList{component.uniqueName, !component.friendlyName.isEmpty() ? component.friendlyName : component.uniqueName, {}, {}};
+    });
 
     return ret;
 }
 
 void GlobalShortcutsRegistry::clear()
 {
+    finishPendingTasks();
     m_components.clear();
+    m_dormantComponents.clear();
+    m_dormantContextNames.clear();
+    m_settingsLoaded = false;
 
     // The shortcuts should have deregistered themselves
     Q_ASSERT(_active_keys.isEmpty());
@@ -369,11 +496,18 @@ void GlobalShortcutsRegistry::deactivateShortcuts(bool temporarily)
 
 Component *GlobalShortcutsRegistry::getComponent(const QString &uniqueName)
 {
-    auto it = findByName(uniqueName);
-    return it != m_components.cend() ? (*it).get() : nullptr;
+    if (auto it = findByName(uniqueName); it != m_components.cend()) {
+        return (*it).get();
+    }
+
+    if (auto it = findDormantByName(uniqueName); it != m_dormantComponents.end()) {
+        return promoteDormantComponent(it);
+    }
+
+    return nullptr;
 }
 
-GlobalShortcut *GlobalShortcutsRegistry::getShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const
+GlobalShortcut *GlobalShortcutsRegistry::findShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const
 {
     for (const ComponentPtr &component : m_components) {
         GlobalShortcut *rc = component->getShortcutByKey(key, type);
@@ -384,7 +518,37 @@ GlobalShortcut *GlobalShortcutsRegistry::getShortcutByKey(const QKeySequence &ke
     return nullptr;
 }
 
-QList<GlobalShortcut *> GlobalShortcutsRegistry::getShortcutsByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const
+GlobalShortcut *GlobalShortcutsRegistry::getShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type)
+{
+    if (GlobalShortcut *rc = findShortcutByKey(key, type)) {
+        return rc;
+    }
+
+    if (key.isEmpty()) {
+        return nullptr;
+    }
+
+    // Dormant components are loaded with the default context active
+    const QKeySequence keyMangled = Utils::normalizeSequence(key);
+    const qsizetype defaultContext = m_dormantContextNames.indexOf(QLatin1String("default"));
+    auto it = std::find_if(m_dormantComponents.begin(), m_dormantComponents.end(), [&](const DormantComponent &component) {
+        for (qsizetype i = 0; i < component.keys.size(); ++i) {
+            if (component.keyContexts[i] == defaultContext && GlobalShortcutContext::keyMatches(keyMangled, component.keys[i], type)) {
+                return true;
+            }
+        }
+        return false;
+    });
+
+    if (it == m_dormantComponents.end()) {
+        return nullptr;
+    }
+
+    Component *component = promoteDormantComponent(it);
+    return component ? component->getShortcutByKey(key, type) : nullptr;
+}
+
+QList<GlobalShortcut *> GlobalShortcutsRegistry::getShortcutsByKey(const QKeySequence &key, KGlobalAccel::MatchType type)
 {
     QList<GlobalShortcut *> rc;
     for (const ComponentPtr &component : m_components) {
@@ -393,14 +557,321 @@ QList<GlobalShortcut *> GlobalShortcutsRegistry::getShortcutsByKey(const QKeySeq
             return rc;
         }
     }
-    return {};
+
+    if (key.isEmpty()) {
+        return {};
+    }
+
+    const QKeySequence keyMangled = Utils::normalizeSequence(key);
+    auto it = std::find_if(m_dormantComponents.begin(), m_dormantComponents.end(), [&](const DormantComponent &component) {
+        return std::any_of(component.keys.cbegin(), component.keys.cend(), [&](const QKeySequence &other) {
+            return GlobalShortcutContext::keyMatches(keyMangled, other, type);
+        });
+    });
+
+    if (it == m_dormantComponents.end()) {
+        return {};
+    }
+
+    Component *component = promoteDormantComponent(it);
+    return component ? component->getShortcutsByKey(key, type) : QList<GlobalShortcut *>{};
 }
 
 bool GlobalShortcutsRegistry::isShortcutAvailable(const QKeySequence &shortcut, const QString &componentName, const QString &contextName) const
 {
-    return std::all_of(m_components.cbegin(), m_components.cend(), [&shortcut, &componentName, &contextName](const ComponentPtr &component) {
-        return component->isShortcutAvailable(shortcut, componentName, contextName);
+    const bool availableInComponents =
+        std::all_of(m_components.cbegin(), m_components.cend(), [&shortcut, &componentName, &contextName](const ComponentPtr &component) {
+            return component->isShortcutAvailable(shortcut, componentName, contextName);
+        });
+    if (!availableInComponents) {
+        return false;
+    }
+
+    // Same rules as Component::isShortcutAvailable(), without loading the dormant components
+    return std::none_of(m_dormantComponents.cbegin(), m_dormantComponents.cend(), [&](const DormantComponent &component) {
+        if (component.uniqueName != componentName) {
+            return Utils::matchSequences(shortcut, component.keys);
+        }
+
+        const qsizetype context = m_dormantContextNames.indexOf(contextName);
+        for (qsizetype i = 0; i < component.keys.size(); ++i) {
+            if (component.keyContexts[i] == context && Utils::matchSequences(shortcut, {component.keys[i]})) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+QList<KGlobalShortcutInfo> GlobalShortcutsRegistry::snapshot(qsizetype first, qsizetype max)
+{
+    promoteDormantComponents();
+
+    // The lists of the components are kept until they change, so a settings
+    // UI asking again and again only pays for the components which changed
+    QList<KGlobalShortcutInfo> result;
+    for (const ComponentPtr &component : m_components) {
+        const QList<KGlobalShortcutInfo> &infos = component->snapshot();
+        if (first >= infos.size()) {
+            first -= infos.size();
+            continue;
+        }
+
+        const qsizetype count = max > 0 ? std::min(infos.size() - first, max - result.size()) : infos.size() - first;
+        result.append(infos.sliced(first, count));
+        first = 0;
+        if (max > 0 && result.size() == max) {
+            break;
+        }
+    }
+    return result;
+}
+
+quint64 GlobalShortcutsRegistry::generation() const
+{
+    return m_generation;
+}
+
+QList<KGlobalShortcutInfo> GlobalShortcutsRegistry::changesSince(quint64 generation, QStringList &components, bool &fullResync)
+{
+    // Another run counted in another epoch, its generations say nothing about this one
+    fullResync = quint32(generation >> 32) != m_epoch || generation < m_changeLogStart || generation > m_generation;
+    if (fullResync) {
+        return {};
+    }
+
+    for (auto it = m_changeLog.crbegin(); it != m_changeLog.crend() && it->first > generation; ++it) {
+        components.prepend(it->second);
+    }
+
+    QList<KGlobalShortcutInfo> result;
+    for (const QString &uniqueName : std::as_const(components)) {
+        if (Component *component = getComponent(uniqueName)) {
+            result.append(component->snapshot());
+        }
+    }
+    return result;
+}
+
+GlobalShortcutsRegistry::HandleName GlobalShortcutsRegistry::handleName(const GlobalShortcut *shortcut)
+{
+    const GlobalShortcutContext *context = shortcut->context();
+    return {context->component()->uniqueName(), context->uniqueName(), shortcut->uniqueName()};
+}
+
+uint GlobalShortcutsRegistry::handle(const GlobalShortcut *shortcut)
+{
+    HandleName name = handleName(shortcut);
+    if (const uint handle = m_handles.value(name)) {
+        return handle;
+    }
+    if (m_handleNames.size() == std::numeric_limits<uint>::max()) {
+        qCWarning(KGLOBALACCELD) << "Out of handles for" << shortcut->uniqueName();
+        return 0;
+    }
+    // Only names a client asked for get one, so there are at most as many as
+    // shortcuts were ever registered, no matter how often they are recreated
+    m_handleNames.push_back(name);
+    m_handles.insert(std::move(name), m_handleNames.size());
+    return m_handleNames.size();
+}
+
+GlobalShortcut *GlobalShortcutsRegistry::shortcutByHandle(uint handle)
+{
+    if (handle == 0 || handle > m_handleNames.size()) {
+        return nullptr;
+    }
+    const HandleName &name = m_handleNames[handle - 1];
+    const Component *component = getComponent(name.component);
+    return component ? component->getShortcutByName(name.shortcut, name.context) : nullptr;
+}
+
+void GlobalShortcutsRegistry::addClient(Component *component, const QDBusConnection &connection, const QString &service)
+{
+    component->addClient(Component::Client{connection.name(), service});
+    watchSubscriber(connection, service);
+}
+
+void GlobalShortcutsRegistry::subscribe(uint handle, const QDBusConnection &connection, const QString &service)
+{
+    Q_ASSERT(handle > 0 && handle <= m_handleNames.size());
+    const Subscriber subscriber{connection.name(), service};
+    QList<Subscriber> &subscribers = m_subscriptions[handle];
+    if (!subscribers.contains(subscriber)) {
+        subscribers.append(subscriber);
+    }
+    watchSubscriber(connection, service);
+}
+
+void GlobalShortcutsRegistry::watchSubscriber(const QDBusConnection &connection, const QString &service)
+{
+    // Peer connections are checked when sending, they have no names to watch
+    if (!service.isEmpty() && connection.name() == m_subscriberWatcher.connection().name()
+        && !m_subscriberWatcher.watchedServices().contains(service)) {
+        m_subscriberWatcher.addWatchedService(service);
+    }
+}
+
+void GlobalShortcutsRegistry::addEventChannel(const QDBusConnection &connection,
+                                              const QString &service,
+                                              const QList<uint> &handles,
+                                              std::unique_ptr<ShortcutEventChannel> channel)
+{
+    removeEventChannel(connection, service);
+    m_eventChannels.push_back({Subscriber{connection.name(), service}, QSet<uint>(handles.cbegin(), handles.cend()), std::move(channel)});
+    watchSubscriber(connection, service);
+}
+
+void GlobalShortcutsRegistry::removeEventChannel(const QDBusConnection &connection, const QString &service)
+{
+    const Subscriber client{connection.name(), service};
+    std::erase_if(m_eventChannels, [&client](const EventChannel &channel) {
+        return channel.client == client;
+    });
+}
+
+void GlobalShortcutsRegistry::unsubscribe(uint handle, const QDBusConnection &connection, const QString &service)
+{
+    auto it = m_subscriptions.find(handle);
+    if (it == m_subscriptions.end()) {
+        return;
+    }
+    it->removeOne(Subscriber{connection.name(), service});
+    if (it->isEmpty()) {
+        m_subscriptions.erase(it);
+    }
+}
+
+void GlobalShortcutsRegistry::subscriberUnregistered(const QString &service)
+{
+    qCDebug(KGLOBALACCELD) << "Dropping the subscriptions of" << service;
+    m_subscriberWatcher.removeWatchedService(service);
+    const Subscriber subscriber{m_subscriberWatcher.connection().name(), service};
+    for (auto it = m_subscriptions.begin(); it != m_subscriptions.end();) {
+        it->removeOne(subscriber);
+        it = it->isEmpty() ? m_subscriptions.erase(it) : std::next(it);
+    }
+    std::erase_if(m_eventChannels, [&subscriber](const EventChannel &channel) {
+        return channel.client == subscriber;
+    });
+    for (const ComponentPtr &component : m_components) {
+        component->removeClient(subscriber);
+    }
+}
+
+bool GlobalShortcutsRegistry::sendToSubscribers(const GlobalShortcut &shortcut, ShortcutKeyState state, qlonglong timestamp)
+{
+    if (m_eventChannels.empty() && m_subscriptions.isEmpty()) {
+        return false;
+    }
+    const uint handle = m_handles.value(handleName(&shortcut));
+    if (!handle) {
+        return false;
+    }
+
+    auto isGone = [](const Subscriber &subscriber) {
+        return !QDBusConnection(subscriber.connectionName).isConnected();
+    };
+    // Only the owner can subscribe or open a channel. As long as others
+    // registered the component as well, they rely on its signals, which the
+    // owner gets then.
+    const Component *component = shortcut.context()->component();
+    bool sent = false;
+
+    // The channels are written directly, no D-Bus involved
+    std::erase_if(m_eventChannels, [&isGone](const EventChannel &channel) {
+        return isGone(channel.client);
     });
+    for (const EventChannel &channel : m_eventChannels) {
+        if (channel.handles.contains(handle) && component->isSoleClient(channel.client)) {
+            channel.channel->write(handle, state, timestamp);
+            sent = true;
+        }
+    }
+
+    const auto it = m_subscriptions.find(handle);
+    if (it == m_subscriptions.end()) {
+        return sent;
+    }
+
+    it->removeIf(isGone);
+    if (it->isEmpty()) {
+        m_subscriptions.erase(it);
+        return sent;
+    }
+
+    // A targeted signal only wakes up the subscriber, unlike the signals of the component.
+    // On a peer connection every signal goes to the one client.
+    const QString path = QStringLiteral("/kglobalaccel");
+    const QString dbusInterface = QStringLiteral("org.kde.KGlobalAccel");
+    const QString name = QStringLiteral("shortcutEvent");
+    for (const Subscriber &subscriber : std::as_const(*it)) {
+        if (!component->isSoleClient(subscriber)) {
+            continue;
+        }
+        QDBusMessage message = subscriber.service.isEmpty() ? QDBusMessage::createSignal(path, dbusInterface, name)
+                                                            : QDBusMessage::createTargetedSignal(subscriber.service, path, dbusInterface, name);
+        message << handle << uint(state) << timestamp;
+        QDBusConnection(subscriber.connectionName).send(message);
+        sent = true;
+    }
+    return sent;
+}
+
+void GlobalShortcutsRegistry::noteComponentChanged(const QString &uniqueName)
+{
+    if (m_promotingDormant) {
+        return;
+    }
+
+    ++m_generation;
+    // Every component is in the log once, with its latest change
+    if (const auto latest = m_latestChanges.constFind(uniqueName); latest != m_latestChanges.cend()) {
+        m_changeLog.erase(*latest);
+    } else if (m_changeLog.size() == s_changeLogSize) {
+        const auto oldest = m_changeLog.cbegin();
+        m_changeLogStart = oldest->first;
+        m_latestChanges.remove(oldest->second);
+        m_changeLog.erase(oldest);
+    }
+    m_latestChanges.insert(uniqueName, m_generation);
+    m_changeLog.emplace_hint(m_changeLog.cend(), m_generation, uniqueName);
+
+    m_generationTimer.start();
+}
+
+QList<QKeySequence> GlobalShortcutsRegistry::contestedKeys() const
+{
+    if (!_manager) {
+        return {};
+    }
+    const QList<int> contested = _manager->contestedKeys();
+    if (contested.isEmpty()) {
+        return {};
+    }
+
+    QList<QKeySequence> keys;
+    for (const ComponentPtr &component : m_components) {
+        const auto shortcuts = component->allShortcuts(component->currentContext()->uniqueName());
+        for (GlobalShortcut *shortcut : shortcuts) {
+            if (!shortcut->isActive()) {
+                continue;
+            }
+            const auto shortcutKeys = shortcut->keys();
+            for (const QKeySequence &key : shortcutKeys) {
+                if (key.isEmpty() || _active_keys.contains(key) || keys.contains(key)) {
+                    continue;
+                }
+                for (int i = 0; i < key.count(); i++) {
+                    if (contested.contains(key[i].toCombined())) {
+                        keys.append(key);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return keys;
 }
 
 static void correctKeyEvent(int &keyQt)
@@ -430,6 +901,15 @@ static void correctKeyEvent(int &keyQt)
 bool GlobalShortcutsRegistry::keyEvent(int keyQt, ShortcutKeyState state)
 {
     correctKeyEvent(keyQt);
+
+    if (state == ShortcutKeyState::Repeated) {
+        if (processRepeat(keyQt)) {
+            return true;
+        }
+        // Not the key of the held shortcut, e.g. a modifier changed in between
+        state = ShortcutKeyState::Pressed;
+    }
+
     const int key = keyQt & ~Qt::KeyboardModifierMask;
     const Qt::KeyboardModifiers modifiers = static_cast<Qt::KeyboardModifiers>(keyQt & Qt::KeyboardModifierMask);
     bool handled = false;
@@ -481,6 +961,33 @@ bool GlobalShortcutsRegistry::keyEvent(int keyQt, ShortcutKeyState state)
     return handled;
 }
 
+bool GlobalShortcutsRegistry::processRepeat(int keyQt)
+{
+    if (!m_lastShortcut) {
+        return false;
+    }
+
+    const auto keys = m_lastShortcut->keys();
+    const bool held = std::any_of(keys.cbegin(), keys.cend(), [keyQt](const QKeySequence &key) {
+        return !key.isEmpty() && key[key.count() - 1].toCombined() == keyQt;
+    });
+    if (!held) {
+        return false;
+    }
+
+    // A held key repeats 25 or more times a second, every repeat goes out on
+    // the bus. Those which come too fast are swallowed.
+    if (m_lastRepeat.isValid() && m_lastRepeat.durationElapsed() < m_minimumRepeatInterval) {
+        return true;
+    }
+    m_lastRepeat.start();
+
+    if (isShortcutAllowed(m_lastShortcut)) {
+        m_lastShortcut->context()->component()->emitGlobalShortcutEvent(*m_lastShortcut, ShortcutKeyState::Repeated);
+    }
+    return true;
+}
+
 bool GlobalShortcutsRegistry::isShortcutAllowed(const GlobalShortcut *shortcut) const
 {
     if (!m_useAllowList) {
@@ -522,7 +1029,8 @@ bool GlobalShortcutsRegistry::processKey(int keyQt, ShortcutKeyState state)
             sequenceToCheck[i] = _active_sequence[_active_sequence.count() - length + i].toCombined();
         }
         tempSequence = QKeySequence(sequenceToCheck[0], sequenceToCheck[1], sequenceToCheck[2], sequenceToCheck[3]);
-        shortcut = getShortcutByKey(tempSequence);
+        // Shortcuts of dormant components are never active
+        shortcut = findShortcutByKey(tempSequence, KGlobalAccel::MatchType::Equal);
 
         if (shortcut) {
             break;
@@ -568,6 +1076,7 @@ bool GlobalShortcutsRegistry::processKey(int keyQt, ShortcutKeyState state)
     // Invoke the action
     shortcut->context()->component()->emitGlobalShortcutEvent(*shortcut, state);
     m_lastShortcut = shortcut;
+    m_lastRepeat.invalidate();
 
     return true;
 }
@@ -602,7 +1111,11 @@ Component *GlobalShortcutsRegistry::createComponent(const QString &uniqueName, c
 
 void GlobalShortcutsRegistry::unregisterComponent(Component *component)
 {
+    component->_registry->noteComponentChanged(component->uniqueName());
     QDBusConnection::sessionBus().unregisterObject(component->dbusPath().path());
+    for (const QString &name : std::as_const(component->_registry->m_peerConnections)) {
+        QDBusConnection(name).unregisterObject(component->dbusPath().path());
+    }
     delete component;
 }
 
@@ -634,7 +1147,7 @@ KServiceActionComponent *GlobalShortcutsRegistry::createServiceActionComponent(c
     KService::Ptr service = KService::serviceByStorageId(uniqueName);
 
     if (!service) {
-        const QString filePath = QStandardPaths::locate(QStandardPaths::GenericDataLocation, QLatin1String("kglobalaccel/") + uniqueName);
+        const QString filePath = m_serviceFiles.value(uniqueName);
         if (filePath.isEmpty()) {
             return nullptr;
         }
@@ -646,6 +1159,25 @@ KServiceActionComponent *GlobalShortcutsRegistry::createServiceActionComponent(c
     return static_cast<KServiceActionComponent *>(c);
 }
 
+KServiceActionComponent *GlobalShortcutsRegistry::loadServiceActionComponent(KService::Ptr service)
+{
+    auto *component = createServiceActionComponent(service);
+    component->activateGlobalShortcutContext(QStringLiteral("default"));
+
+    if (const KConfigGroup configGroup = _config.group(QStringLiteral("services")).group(component->uniqueName()); configGroup.exists()) {
+        component->loadSettings(configGroup, service);
+    } else {
+        component->loadFromService(service);
+    }
+    return component;
+}
+
+void GlobalShortcutsRegistry::loadRepeatSettings()
+{
+    KConfig config(u"kglobalaccelrc"_s);
+    m_minimumRepeatInterval = std::chrono::milliseconds(config.group(u"General"_s).readEntry("minimumRepeatInterval", 50));
+}
+
 void GlobalShortcutsRegistry::loadAllowListSettings()
 {
     KConfig config(u"kglobalaccelrc"_s);
@@ -674,12 +1206,22 @@ void GlobalShortcutsRegistry::loadAllowListSettings()
 
 void GlobalShortcutsRegistry::loadSettings()
 {
-    if (!m_components.empty()) {
+    if (m_settingsLoaded) {
         qCDebug(KGLOBALACCELD) << "Registry settings already loaded. Skipped loading again.";
         return;
     }
+    m_settingsLoaded = true;
+
+    // Looking for applications with shortcuts only queues their loading, which
+    // comes after the components below. Done first, a client asking for one
+    // component doesn't have to wait for all the others to be loaded.
+    queueTask([this] {
+        detectAppsWithShortcuts();
+    });
 
-    auto groupList = _config.groupList();
+    // Every component is loaded in a task of its own, key events are processed
+    // in between and only ever see completely loaded components.
+    const QStringList groupList = _config.groupList();
     for (const QString &groupName : groupList) {
         if (groupName == QLatin1String("services")) {
             continue;
@@ -689,89 +1231,283 @@ void GlobalShortcutsRegistry::loadSettings()
             continue;
         }
 
-        qCDebug(KGLOBALACCELD) << "Loading group " << groupName;
+        // No application is running yet, keep the components dormant until they show up
+        queueTask(
+            [this, groupName] {
+                loadDormantComponent(groupName);
+            },
+            groupName);
+    }
 
-        Q_ASSERT(groupName.indexOf(QLatin1Char('\x1d')) == -1);
+    const QStringList serviceGroupList = _config.group(QStringLiteral("services")).groupList();
+    for (const QString &groupName : serviceGroupList) {
+        queueTask(
+            [this, groupName] {
+                loadServiceSettings(groupName);
+            },
+            groupName);
+    }
 
-        // loadSettings isn't designed to be called in between. Only at the
-        // beginning.
-        Q_ASSERT(!getComponent(groupName));
+    // Load the configured KServiceActions
+    for (auto [fileName, file] : m_serviceFiles.asKeyValueRange()) {
+        queueTask(
+            [this, fileName, file] {
+                auto it = findByName(fileName);
+                if (it != m_components.cend()) {
+                    return;
+                }
 
-        const KConfigGroup configGroup(&_config, groupName);
+                KService::Ptr service(new KService(file));
+                if (service->noDisplay()) {
+                    return;
+                }
 
-        const QString friendlyName = configGroup.readEntry("_k_friendly_name");
+                auto *actionComp = createServiceActionComponent(service);
+                actionComp->activateGlobalShortcutContext(QStringLiteral("default"));
+                actionComp->loadFromService(service);
+            },
+            fileName);
+    }
 
-        Component *component = createComponent(groupName, friendlyName);
+    loadAllowListSettings();
+    loadRepeatSettings();
+}
 
-        // Now load the contexts
-        const auto groupList = configGroup.groupList();
-        for (const QString &context : groupList) {
-            // Skip the friendly name group, this was previously used instead of _k_friendly_name
-            if (context == QLatin1String("Friendly Name")) {
-                continue;
-            }
+void GlobalShortcutsRegistry::loadComponentSettings(const QString &groupName)
+{
+    qCDebug(KGLOBALACCELD) << "Loading group " << groupName;
+
+    Q_ASSERT(groupName.indexOf(QLatin1Char('\x1d')) == -1);
+
+    // loadSettings isn't designed to be called in between. Only at the
+    // beginning, or to promote a dormant component.
+    Q_ASSERT(findByName(groupName) == m_components.cend());
+
+    const KConfigGroup configGroup(&_config, groupName);
+
+    const QString friendlyName = configGroup.readEntry("_k_friendly_name");
 
-            const KConfigGroup contextGroup(&configGroup, context);
-            QString contextFriendlyName = contextGroup.readEntry("_k_friendly_name");
-            component->createGlobalShortcutContext(context, contextFriendlyName);
-            component->activateGlobalShortcutContext(context);
-            component->loadSettings(contextGroup);
+    Component *component = createComponent(groupName, friendlyName);
+
+    // Now load the contexts
+    const auto groupList = configGroup.groupList();
+    for (const QString &context : groupList) {
+        // Skip the friendly name group, this was previously used instead of _k_friendly_name
+        if (context == QLatin1String("Friendly Name")) {
+            continue;
         }
 
-        // Load the default context
-        component->activateGlobalShortcutContext(QStringLiteral("default"));
-        component->loadSettings(configGroup);
+        const KConfigGroup contextGroup(&configGroup, context);
+        QString contextFriendlyName = contextGroup.readEntry("_k_friendly_name");
+        component->createGlobalShortcutContext(context, contextFriendlyName);
+        component->activateGlobalShortcutContext(context);
+        component->loadSettings(contextGroup);
     }
 
-    groupList = _config.group(QStringLiteral("services")).groupList();
-    for (const QString &groupName : groupList) {
-        qCDebug(KGLOBALACCELD) << "Loading group " << groupName;
+    // Load the default context
+    component->activateGlobalShortcutContext(QStringLiteral("default"));
+    component->loadSettings(configGroup);
+}
+
+void GlobalShortcutsRegistry::loadDormantComponent(const QString &groupName)
+{
+    Q_ASSERT(groupName.indexOf(QLatin1Char('\x1d')) == -1);
+
+    const KConfigGroup configGroup(&_config, groupName);
 
-        Q_ASSERT(groupName.indexOf(QLatin1Char('\x1d')) == -1);
+    DormantComponent component;
+    component.uniqueName = groupName;
+    component.friendlyName = configGroup.readEntry("_k_friendly_name");
 
-        // loadSettings isn't designed to be called in between. Only at the
-        // beginning.
-        Q_ASSERT(!getComponent(groupName));
+    auto readKeys = [this, &component](const KConfigGroup &group, const QString &context) {
+        qsizetype contextIndex = m_dormantContextNames.indexOf(context);
+        if (contextIndex == -1) {
+            contextIndex = m_dormantContextNames.size();
+            m_dormantContextNames.append(context);
+        }
 
-        const KConfigGroup configGroup = _config.group(QStringLiteral("services")).group(groupName);
+        const auto listKeys = group.keyList();
+        for (const QString &confKey : listKeys) {
+            const QStringList entry = group.readEntry(confKey, QStringList());
+            if (entry.size() != 3) {
+                continue;
+            }
 
-        Component *component = createServiceActionComponent(groupName);
+            const auto keys = Component::keysFromString(entry[0]);
+            for (const QKeySequence &key : keys) {
+                if (!key.isEmpty()) {
+                    component.keys.append(key);
+                    component.keyContexts.append(contextIndex);
+                }
+            }
+        }
+    };
 
-        if (!component) {
-            qDebug() << "could not create a component for " << groupName;
+    const auto groupList = configGroup.groupList();
+    for (const QString &context : groupList) {
+        // Skip the friendly name group, this was previously used instead of _k_friendly_name
+        if (context == QLatin1String("Friendly Name")) {
             continue;
         }
-        Q_ASSERT(!component->uniqueName().isEmpty());
-        component->activateGlobalShortcutContext(QStringLiteral("default"));
-        component->loadSettings(configGroup);
+        readKeys(KConfigGroup(&configGroup, context), context);
     }
+    readKeys(configGroup, QStringLiteral("default"));
 
-    // Load the configured KServiceActions
-    const QStringList desktopPaths =
-        QStandardPaths::locateAll(QStandardPaths::GenericDataLocation, QStringLiteral("kglobalaccel"), QStandardPaths::LocateDirectory);
+    component.keys.squeeze();
+    component.keyContexts.squeeze();
+    m_dormantComponents.push_back(std::move(component));
+}
 
-    const QStringList desktopFiles = KFileUtils::findAllUniqueFiles(desktopPaths, {QStringLiteral("*.desktop")});
+Component *GlobalShortcutsRegistry::promoteDormantComponent(DormantComponentVec::iterator it)
+{
+    const QString groupName = it->uniqueName;
+    qCDebug(KGLOBALACCELD) << "Loading dormant component" << groupName;
 
-    for (const QString &file : desktopFiles) {
-        const QString fileName = QFileInfo(file).fileName();
-        auto it = findByName(fileName);
-        if (it != m_components.cend()) {
+    // Remove it first, loading can check the keys of and promote other dormant components
+    m_dormantComponents.erase(it);
+    const bool wasPromoting = std::exchange(m_promotingDormant, true);
+    loadComponentSettings(groupName);
+    m_promotingDormant = wasPromoting;
+
+    auto componentIt = findByName(groupName);
+    return componentIt != m_components.cend() ? (*componentIt).get() : nullptr;
+}
+
+void GlobalShortcutsRegistry::promoteDormantComponents()
+{
+    while (!m_dormantComponents.empty()) {
+        promoteDormantComponent(m_dormantComponents.begin());
+    }
+}
+
+void GlobalShortcutsRegistry::watchConfigFile()
+{
+    // The file is replaced on every write, which removes it from the watcher
+    if (!m_configFilePath.isEmpty() && !m_configFileWatcher.files().contains(m_configFilePath) && QFileInfo::exists(m_configFilePath)) {
+        m_configFileWatcher.addPath(m_configFilePath);
+    }
+}
+
+void GlobalShortcutsRegistry::syncConfig()
+{
+    _config.sync();
+    m_configFileHash = configFileHash();
+    watchConfigFile();
+}
+
+QByteArray GlobalShortcutsRegistry::configFileHash() const
+{
+    QFile file(m_configFilePath);
+    if (m_configFilePath.isEmpty() || !file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
+    return QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha1);
+}
+
+void GlobalShortcutsRegistry::reloadConfig()
+{
+    watchConfigFile();
+
+    if (configFileHash() == m_configFileHash) {
+        // Written by us, or touched without changes
+        return;
+    }
+
+    qCDebug(KGLOBALACCELD) << "Reloading" << m_configFilePath << "after it was changed";
+
+    // Changes not written yet would be reverted by reading the file, write
+    // them first. Syncing keeps what was changed in the file for the others.
+    writePendingSettings();
+    finishPendingTasks();
+    _config.reparseConfiguration();
+    m_configFileHash = configFileHash();
+
+    if (!m_settingsLoaded) {
+        // Not loaded yet, loadSettings() will see the new content
+        return;
+    }
+
+    Component::KeyChanges keyChanges;
+    const KConfigGroup services = _config.group(QStringLiteral("services"));
+    for (const ComponentPtr &component : m_components) {
+        const bool isService = component->uniqueName().endsWith(QLatin1String(".desktop"));
+        const KConfigGroup configGroup = isService ? services.group(component->uniqueName()) : _config.group(component->uniqueName());
+        component->reloadSettings(configGroup, keyChanges);
+    }
+
+    // Dormant components only mirror their config group, read them again.
+    // The context indices change with that, compare the context names.
+    auto dormantState = [this](const DormantComponent &component) {
+        QStringList contexts;
+        contexts.reserve(component.keyContexts.size());
+        for (qsizetype context : component.keyContexts) {
+            contexts.append(m_dormantContextNames.at(context));
+        }
+        return std::make_tuple(component.friendlyName, component.keys, contexts);
+    };
+    QHash<QString, std::tuple<QString, QList<QKeySequence>, QStringList>> oldDormant;
+    for (const DormantComponent &component : std::as_const(m_dormantComponents)) {
+        oldDormant.insert(component.uniqueName, dormantState(component));
+    }
+    m_dormantComponents.clear();
+    m_dormantContextNames.clear();
+    const QStringList groupList = _config.groupList();
+    for (const QString &groupName : groupList) {
+        if (groupName == QLatin1String("services") || groupName.endsWith(QLatin1String(".desktop"))) {
             continue;
         }
+        if (findByName(groupName) == m_components.cend()) {
+            loadDormantComponent(groupName);
+            const auto it = oldDormant.constFind(groupName);
+            if (it == oldDormant.cend() || *it != dormantState(m_dormantComponents.back())) {
+                noteComponentChanged(groupName);
+            }
+            oldDormant.remove(groupName);
+        }
+    }
+    // Removed from the file
+    for (auto it = oldDormant.cbegin(); it != oldDormant.cend(); ++it) {
+        noteComponentChanged(it.key());
+    }
 
-        KService::Ptr service(new KService(file));
-        if (service->noDisplay()) {
-            continue;
+    // Take the old keys away first, so that keys can move between shortcuts.
+    // Only the keys of changed shortcuts are ungrabbed and grabbed again.
+    for (const auto &[shortcut, keys] : std::as_const(keyChanges)) {
+        shortcut->setKeys({});
+    }
+    for (const auto &[shortcut, keys] : std::as_const(keyChanges)) {
+        shortcut->setKeys(keys);
+
+        if (shortcut->isPresent()) {
+            const Component *component = shortcut->context()->component();
+            const QStringList actionId{component->uniqueName(), shortcut->uniqueName(), component->friendlyName(), shortcut->friendlyName()};
+            Q_EMIT shortcutKeysReloaded(actionId, shortcut->keys());
         }
+    }
+}
+
+void GlobalShortcutsRegistry::loadServiceSettings(const QString &groupName)
+{
+    qCDebug(KGLOBALACCELD) << "Loading group " << groupName;
+
+    Q_ASSERT(groupName.indexOf(QLatin1Char('\x1d')) == -1);
 
-        auto *actionComp = createServiceActionComponent(service);
-        actionComp->activateGlobalShortcutContext(QStringLiteral("default"));
-        actionComp->loadFromService();
+    if (findByName(groupName) != m_components.cend()) {
+        // Created in the meantime, e.g. because its file was added to kglobalaccel/
+        return;
     }
 
-    detectAppsWithShortcuts();
+    const KConfigGroup configGroup = _config.group(QStringLiteral("services")).group(groupName);
 
-    loadAllowListSettings();
+    Component *component = createServiceActionComponent(groupName);
+
+    if (!component) {
+        qDebug() << "could not create a component for " << groupName;
+        return;
+    }
+    Q_ASSERT(!component->uniqueName().isEmpty());
+    component->activateGlobalShortcutContext(QStringLiteral("default"));
+    component->loadSettings(configGroup);
 }
 
 void GlobalShortcutsRegistry::detectAppsWithShortcuts()
@@ -788,26 +1524,214 @@ void GlobalShortcutsRegistry::detectAppsWithShortcuts()
     });
 
     for (auto service : appsWithShortcuts) {
-        auto it = findByName(service->storageId());
-        if (it != m_components.cend()) {
-            // already there
-            continue;
+        queueTask(
+            [this, service] {
+                auto it = findByName(service->storageId());
+                if (it != m_components.cend()) {
+                    // already there
+                    return;
+                }
+
+                loadServiceActionComponent(service);
+            },
+            service->storageId());
+    }
+}
+
+void GlobalShortcutsRegistry::watchServiceDirectories()
+{
+    connect(&m_serviceFilesWatcher, &QFileSystemWatcher::directoryChanged, this, &GlobalShortcutsRegistry::watchedDirectoryChanged);
+    connect(&m_serviceFilesWatcher, &QFileSystemWatcher::fileChanged, this, &GlobalShortcutsRegistry::serviceFileChanged);
+
+    QStringList directories = serviceDirectories();
+    if (const QString userDirectory = userServiceDirectory(); !directories.contains(userDirectory)) {
+        // Files dropped there later have to be noticed as well
+        const QString parent = QFileInfo(userDirectory).path();
+        if (QFileInfo::exists(parent)) {
+            directories.append(parent);
         }
+    }
+    if (!directories.isEmpty()) {
+        m_serviceFilesWatcher.addPaths(directories);
+    }
 
-        auto *component = createServiceActionComponent(service);
-        component->activateGlobalShortcutContext(QStringLiteral("default"));
+    m_serviceFiles = findServiceFiles();
+    if (!m_serviceFiles.isEmpty()) {
+        m_serviceFilesWatcher.addPaths(m_serviceFiles.values());
+    }
+}
 
-        if (const KConfigGroup configGroup = _config.group(QStringLiteral("services")).group(component->uniqueName()); configGroup.exists()) {
-            component->loadSettings(configGroup);
-        } else {
-            component->loadFromService();
+void GlobalShortcutsRegistry::watchedDirectoryChanged(const QString &path)
+{
+    const QString userDirectory = userServiceDirectory();
+    if (path != QFileInfo(userDirectory).path()) {
+        serviceDirectoryChanged();
+        return;
+    }
+
+    // Something else changed in the data directory
+    if (!QFileInfo(userDirectory).isDir()) {
+        return;
+    }
+    qCDebug(KGLOBALACCELD) << "Service directory created" << userDirectory;
+    m_serviceFilesWatcher.removePath(path);
+    m_serviceFilesWatcher.addPath(userDirectory);
+    serviceDirectoryChanged();
+}
+
+void GlobalShortcutsRegistry::serviceDirectoryChanged()
+{
+    finishPendingTasks();
+
+    // Listing the directories is cheap, only the files that actually changed are parsed
+    const QHash<QString, QString> oldServiceFiles = std::exchange(m_serviceFiles, findServiceFiles());
+
+    for (auto [fileName, oldPath] : oldServiceFiles.asKeyValueRange()) {
+        const QString newPath = m_serviceFiles.value(fileName);
+        if (newPath.isEmpty()) {
+            qCDebug(KGLOBALACCELD) << "Service file removed" << oldPath;
+            m_serviceFilesWatcher.removePath(oldPath);
+            removeServiceComponent(fileName);
+        } else if (newPath != oldPath) {
+            // A file in a directory with a higher priority shadows the old one now, or the other way around
+            qCDebug(KGLOBALACCELD) << "Service file" << fileName << "moved from" << oldPath << "to" << newPath;
+            m_serviceFilesWatcher.removePath(oldPath);
+            m_serviceFilesWatcher.addPath(newPath);
+            reloadServiceComponent(fileName);
+        }
+    }
+
+    for (auto [fileName, path] : m_serviceFiles.asKeyValueRange()) {
+        if (!oldServiceFiles.contains(fileName)) {
+            qCDebug(KGLOBALACCELD) << "Service file added" << path;
+            m_serviceFilesWatcher.addPath(path);
+            reloadServiceComponent(fileName);
         }
     }
 }
 
+void GlobalShortcutsRegistry::serviceFileChanged(const QString &path)
+{
+    finishPendingTasks();
+
+    const QString fileName = QFileInfo(path).fileName();
+    if (m_serviceFiles.value(fileName) != path || !QFileInfo::exists(path)) {
+        // Removals are handled by serviceDirectoryChanged()
+        return;
+    }
+
+    // Files which are replaced atomically drop out of the watcher
+    if (!m_serviceFilesWatcher.files().contains(path)) {
+        m_serviceFilesWatcher.addPath(path);
+    }
+
+    qCDebug(KGLOBALACCELD) << "Service file changed" << path;
+    reloadServiceComponent(fileName);
+}
+
+void GlobalShortcutsRegistry::reloadServiceComponent(const QString &fileName)
+{
+    if (KService::serviceByStorageId(fileName)) {
+        // Installed applications take precedence over files in kglobalaccel/
+        return;
+    }
+
+    if (auto it = findByName(fileName); it != m_components.cend()) {
+        // Keep the shortcuts the user changed
+        KConfigGroup configGroup = _config.group(QStringLiteral("services")).group(fileName);
+        (*it)->writeSettings(configGroup);
+        m_components.erase(it);
+    }
+
+    const QString path = m_serviceFiles.value(fileName);
+    if (path.isEmpty()) {
+        return;
+    }
+
+    KService::Ptr service(new KService(path));
+    if (service->noDisplay()) {
+        return;
+    }
+
+    loadServiceActionComponent(service);
+}
+
+void GlobalShortcutsRegistry::removeServiceComponent(const QString &fileName)
+{
+    if (KService::serviceByStorageId(fileName)) {
+        // still there
+        return;
+    }
+
+    if (auto it = findByName(fileName); it != m_components.cend()) {
+        m_components.erase(it);
+    }
+}
+
 void GlobalShortcutsRegistry::grabKeys()
 {
-    activateShortcuts();
+    for (const ComponentPtr &component : m_components) {
+        queueTask(
+            [this, component = QPointer<Component>(component.get())] {
+                if (component) {
+                    beginGrabBatch();
+                    component->activateShortcuts();
+                    endGrabBatch();
+                }
+            },
+            component->uniqueName());
+    }
+}
+
+void GlobalShortcutsRegistry::grabFailedKeys()
+{
+    for (const ComponentPtr &component : m_components) {
+        queueTask(
+            [this, component = QPointer<Component>(component.get())] {
+                if (!component) {
+                    return;
+                }
+
+                beginGrabBatch();
+                const auto shortcuts = component->allShortcuts(component->currentContext()->uniqueName());
+                for (GlobalShortcut *shortcut : shortcuts) {
+                    if (!shortcut->isActive()) {
+                        continue;
+                    }
+                    const auto keys = shortcut->keys();
+                    for (const QKeySequence &key : keys) {
+                        if (!key.isEmpty() && !_active_keys.contains(key)) {
+                            registerKey(key, shortcut);
+                        }
+                    }
+                }
+                endGrabBatch();
+            },
+            component->uniqueName());
+    }
+}
+
+void GlobalShortcutsRegistry::keysLost(const QList<int> &keys)
+{
+    QList<std::pair<QKeySequence, GlobalShortcut *>> lost;
+    for (auto it = _active_keys.cbegin(); it != _active_keys.cend(); ++it) {
+        const QKeySequence &key = it.key();
+        if (isModifierOnly(key)) {
+            continue;
+        }
+        for (int i = 0; i < key.count(); i++) {
+            if (keys.contains(key[i].toCombined())) {
+                lost.append({key, it.value()});
+                break;
+            }
+        }
+    }
+
+    // The shortcuts stay active, grabFailedKeys() registers them again once their keys can be grabbed
+    for (const auto &[key, shortcut] : std::as_const(lost)) {
+        qCDebug(KGLOBALACCELD) << shortcut->uniqueName() << ": Lost the grab of" << key.toString();
+        unregisterKey(key, shortcut);
+    }
 }
 
 bool GlobalShortcutsRegistry::registerKey(const QKeySequence &key, GlobalShortcut *shortcut)
@@ -827,20 +1751,107 @@ bool GlobalShortcutsRegistry::registerKey(const QKeySequence &key, GlobalShortcu
     qCDebug(KGLOBALACCELD) << "Registering key" << QKeySequence(key).toString() << "for" << shortcut->context()->component()->uniqueName() << ":"
                            << shortcut->uniqueName();
 
-    bool error = false;
-    int i;
-    for (i = 0; i < key.count(); i++) {
+    if (isModifierOnly(key)) {
+        _active_keys.insert(key, shortcut);
+        if (m_modifierOnlyShortcuts++ == 0) {
+            _manager->setModifierOnlyShortcutsActive(true);
+        }
+        return true;
+    }
+
+    // Keys which are grabbed already only get another reference
+    QList<int> newKeys;
+    for (int i = 0; i < key.count(); i++) {
         const int combined = key[i].toCombined();
-        if (!_manager->grabKey(combined, true)) {
-            error = true;
-            break;
+        if (_keys_count.value(combined) == 0 && !newKeys.contains(combined)) {
+            // A key released earlier in the batch is still grabbed, e.g. when it moves to another shortcut
+            if (m_grabBatch && m_grabBatch->releasedKeys.removeOne(combined)) {
+                continue;
+            }
+            newKeys.append(combined);
+        }
+    }
+
+    if (m_grabBatch) {
+        // Grabbed in endGrabBatch(), together with the keys of the other shortcuts
+        m_grabBatch->keys.append(newKeys);
+        m_grabBatch->sequences.append(key);
+    } else {
+        const QList<bool> results = _manager->grabKeysBatch(newKeys, true);
+        if (results.contains(false)) {
+            // Release the keys which were grabbed, the sequence is only registered as a whole
+            QList<int> grabbedKeys;
+            for (qsizetype i = 0; i < newKeys.size(); ++i) {
+                if (results[i]) {
+                    grabbedKeys.append(newKeys[i]);
+                }
+            }
+            _manager->grabKeysBatch(grabbedKeys, false);
+            return false;
+        }
+    }
+
+    for (int i = 0; i < key.count(); i++) {
+        ++_keys_count[key[i].toCombined()];
+    }
+    _active_keys.insert(key, shortcut);
+
+    return true;
+}
+
+void GlobalShortcutsRegistry::beginGrabBatch()
+{
+    Q_ASSERT(!m_grabBatch);
+    m_grabBatch.emplace();
+}
+
+void GlobalShortcutsRegistry::endGrabBatch()
+{
+    Q_ASSERT(m_grabBatch);
+    const GrabBatch batch = std::move(*m_grabBatch);
+    m_grabBatch.reset();
+
+    if (!_manager) {
+        return;
+    }
+
+    if (!batch.releasedKeys.isEmpty()) {
+        _manager->grabKeysBatch(batch.releasedKeys, false);
+    }
+    if (batch.keys.isEmpty()) {
+        return;
+    }
+
+    const QList<bool> results = _manager->grabKeysBatch(batch.keys, true);
+    QList<int> failedKeys;
+    for (qsizetype i = 0; i < batch.keys.size(); ++i) {
+        if (!results[i]) {
+            failedKeys.append(batch.keys[i]);
         }
-        ++_keys_count[combined];
     }
+    if (failedKeys.isEmpty()) {
+        return;
+    }
+
+    // Unregister every sequence with a key that could not be grabbed, like
+    // registerKey() would have done. Its other keys are released again once
+    // nobody uses them anymore.
+    QList<int> releasedKeys;
+    for (const QKeySequence &key : batch.sequences) {
+        bool failed = false;
+        for (int i = 0; i < key.count(); i++) {
+            failed |= failedKeys.contains(key[i].toCombined());
+        }
+        if (!failed) {
+            continue;
+        }
+
+        GlobalShortcut *shortcut = _active_keys.take(key);
+        if (shortcut) {
+            qCDebug(KGLOBALACCELD) << shortcut->uniqueName() << ": Failed to register " << key.toString();
+        }
 
-    if (error) {
-        // Last key was not registered, rewind index by 1
-        for (--i; i >= 0; i--) {
+        for (int i = 0; i < key.count(); i++) {
             const int combined = key[i].toCombined();
             auto it = _keys_count.find(combined);
             if (it == _keys_count.end()) {
@@ -849,17 +1860,16 @@ bool GlobalShortcutsRegistry::registerKey(const QKeySequence &key, GlobalShortcu
 
             if (it.value() == 1) {
                 _keys_count.erase(it);
-                _manager->grabKey(combined, false);
+                if (!failedKeys.contains(combined)) {
+                    releasedKeys.append(combined);
+                }
             } else {
                 --(it.value());
             }
         }
-        return false;
     }
 
-    _active_keys.insert(key, shortcut);
-
-    return true;
+    _manager->grabKeysBatch(releasedKeys, false);
 }
 
 void GlobalShortcutsRegistry::setDBusPath(const QDBusObjectPath &path)
@@ -869,7 +1879,19 @@ void GlobalShortcutsRegistry::setDBusPath(const QDBusObjectPath &path)
 
 void GlobalShortcutsRegistry::ungrabKeys()
 {
-    deactivateShortcuts();
+    // The keys of a component are released together, which updates what the
+    // plugin keeps of its grabs as well
+    for (const ComponentPtr &component : m_components) {
+        queueTask(
+            [this, component = QPointer<Component>(component.get())] {
+                if (component) {
+                    beginGrabBatch();
+                    component->deactivateShortcuts();
+                    endGrabBatch();
+                }
+            },
+            component->uniqueName());
+    }
 }
 
 bool GlobalShortcutsRegistry::unregisterKey(const QKeySequence &key, GlobalShortcut *shortcut)
@@ -894,7 +1916,12 @@ bool GlobalShortcutsRegistry::unregisterKey(const QKeySequence &key, GlobalShort
             qCDebug(KGLOBALACCELD) << "Unregistering key" << QKeySequence(key[i]).toString() << "for" << shortcut->context()->component()->uniqueName() << ":"
                                    << shortcut->uniqueName();
 
-            _manager->grabKey(key[i].toCombined(), false);
+            // Keys still waiting in a batch were never grabbed, the others are released with the batch
+            if (!m_grabBatch) {
+                _manager->grabKey(key[i].toCombined(), false);
+            } else if (!m_grabBatch->keys.removeOne(key[i].toCombined())) {
+                m_grabBatch->releasedKeys.append(key[i].toCombined());
+            }
             _keys_count.erase(iter);
         } else {
             qCDebug(KGLOBALACCELD) << "Refused to unregister key" << QKeySequence(key[i]).toString() << ": used by another global shortcut";
@@ -908,28 +1935,62 @@ bool GlobalShortcutsRegistry::unregisterKey(const QKeySequence &key, GlobalShort
     }
 
     _active_keys.remove(key);
+    if (isModifierOnly(key)) {
+        if (--m_modifierOnlyShortcuts == 0) {
+            _manager->setModifierOnlyShortcutsActive(false);
+        }
+    } else if (m_grabBatch) {
+        m_grabBatch->sequences.removeOne(key);
+    }
     return true;
 }
 
 void GlobalShortcutsRegistry::writeSettings()
 {
-    auto it = std::remove_if(m_components.begin(), m_components.end(), [this](const ComponentPtr &component) {
-        bool isService = component->uniqueName().endsWith(QLatin1String(".desktop"));
+    for (const ComponentPtr &component : m_components) {
+        queueTask(
+            [this, component = QPointer<Component>(component.get())] {
+                if (!component) {
+                    return;
+                }
 
-        KConfigGroup configGroup =
-            isService ? _config.group(QStringLiteral("services")).group(component->uniqueName()) : _config.group(component->uniqueName());
+                bool isService = component->uniqueName().endsWith(QLatin1String(".desktop"));
 
-        if (component->allShortcuts().isEmpty()) {
-            configGroup.deleteGroup();
-            return true;
-        } else {
-            component->writeSettings(configGroup);
-            return false;
-        }
+                KConfigGroup configGroup =
+                    isService ? _config.group(QStringLiteral("services")).group(component->uniqueName()) : _config.group(component->uniqueName());
+
+                if (component->allShortcuts().isEmpty()) {
+                    configGroup.deleteGroup();
+                } else {
+                    component->writeSettings(configGroup);
+                }
+            },
+            component->uniqueName());
+    }
+
+    queueTask([this] {
+        auto it = std::remove_if(m_components.begin(), m_components.end(), [](const ComponentPtr &component) {
+            return component->allShortcuts().isEmpty();
+        });
+
+        m_components.erase(it, m_components.end());
+        syncConfig();
     });
+}
 
-    m_components.erase(it, m_components.end());
-    _config.sync();
+void GlobalShortcutsRegistry::scheduleWriteSettings()
+{
+    if (!m_writeSettingsTimer.isActive()) {
+        m_writeSettingsTimer.start();
+    }
+}
+
+void GlobalShortcutsRegistry::writePendingSettings()
+{
+    if (m_writeSettingsTimer.isActive()) {
+        m_writeSettingsTimer.stop();
+        writeSettings();
+    }
 }
 
 void GlobalShortcutsRegistry::scheduleRefreshServices()
@@ -939,8 +2000,10 @@ void GlobalShortcutsRegistry::scheduleRefreshServices()
 
 void GlobalShortcutsRegistry::refreshServices()
 {
+    finishPendingTasks();
+
     // Remove shortcuts for no longer existing apps
-    auto it = std::remove_if(m_components.begin(), m_components.end(), [](const ComponentPtr &component) {
+    auto it = std::remove_if(m_components.begin(), m_components.end(), [this](const ComponentPtr &component) {
         bool isService = component->uniqueName().endsWith(QLatin1String(".desktop"));
 
         if (!isService) {
@@ -952,7 +2015,7 @@ void GlobalShortcutsRegistry::refreshServices()
             return false;
         }
 
-        if (!QStandardPaths::locate(QStandardPaths::GenericDataLocation, QLatin1String("kglobalaccel/") + component->uniqueName()).isEmpty()) {
+        if (m_serviceFiles.contains(component->uniqueName())) {
             // still there
             return false;
         }
@@ -971,4 +2034,72 @@ KGlobalAccelInterface *GlobalShortcutsRegistry::interface() const
     return _manager;
 }
 
+void GlobalShortcutsRegistry::queueTask(std::function<void()> task, const QString &component)
+{
+    m_pendingTasks.push_back({component, std::move(task)});
+    if (!m_pendingTasksTimer.isActive()) {
+        m_pendingTasksTimer.start();
+    }
+}
+
+void GlobalShortcutsRegistry::runPendingTasks()
+{
+    // Only run tasks for one time slice, the key events which arrived in the
+    // meantime are processed before we continue in the next event loop iteration.
+    const QDeadlineTimer deadline(s_pendingTasksTimeSlice);
+    while (!m_pendingTasks.empty()) {
+        auto task = std::move(m_pendingTasks.front());
+        m_pendingTasks.pop_front();
+        task.run();
+
+        if (deadline.hasExpired()) {
+            break;
+        }
+    }
+
+    if (!m_pendingTasks.empty()) {
+        m_pendingTasksTimer.start();
+    }
+}
+
+void GlobalShortcutsRegistry::finishPendingTasks()
+{
+    m_pendingTasksTimer.stop();
+    while (!m_pendingTasks.empty()) {
+        auto task = std::move(m_pendingTasks.front());
+        m_pendingTasks.pop_front();
+        task.run();
+    }
+}
+
+void GlobalShortcutsRegistry::finishPendingTasks(const QString &uniqueName)
+{
+    // Tasks can queue more tasks, look again after every one
+    while (true) {
+        const auto it = std::find_if(m_pendingTasks.begin(), m_pendingTasks.end(), [&uniqueName](const PendingTask &task) {
+            return task.component.isEmpty() || task.component == uniqueName;
+        });
+        if (it == m_pendingTasks.end()) {
+            break;
+        }
+
+        if (it->component.isEmpty()) {
+            // It may touch any component, so the tasks before it have to run first
+            std::deque<PendingTask> tasks(std::make_move_iterator(m_pendingTasks.begin()), std::make_move_iterator(std::next(it)));
+            m_pendingTasks.erase(m_pendingTasks.begin(), std::next(it));
+            for (PendingTask &task : tasks) {
+                task.run();
+            }
+        } else {
+            PendingTask task = std::move(*it);
+            m_pendingTasks.erase(it);
+            task.run();
+        }
+    }
+
+    if (m_pendingTasks.empty()) {
+        m_pendingTasksTimer.stop();
+    }
+}
+
 #include "moc_globalshortcutsregistry.cpp"
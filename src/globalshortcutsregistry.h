@@ -17,14 +17,23 @@
 #include <KSharedConfig>
 
 #include <QDBusObjectPath>
+#include <QDBusServiceWatcher>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
 #include <QHash>
 #include <QKeySequence>
 #include <QObject>
+#include <QSet>
 #include <QTimer>
 
 #include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <optional>
 
 #include "kglobalaccel_export.h"
+#include "shortcuteventchannel.h"
 #include "shortcutkeystate.h"
 
 class Component;
@@ -65,8 +74,9 @@ public:
      * Returns a list of D-Bus paths of registered Components.
      *
      * The returned paths are absolute (i.e. no need to prepend anything).
+     * Dormant components are loaded completely, so that they can be exported.
      */
-    QList<QDBusObjectPath> componentsDbusPaths() const;
+    QList<QDBusObjectPath> componentsDbusPaths();
 
     /**
      * Returns a list of QStringLists (one string list per registered component,
@@ -86,6 +96,8 @@ public:
     void deactivateShortcuts(bool temporarily = false);
 
     /**
+     * Returns the component @p uniqueName, a dormant component is loaded
+     * completely first.
      */
     Component *getComponent(const QString &uniqueName);
 
@@ -94,9 +106,12 @@ public:
      * are considered. But if the matching application uses contexts only one
      * shortcut is returned.
      *
+     * If the shortcut belongs to a dormant component, that one is loaded
+     * completely.
+     *
      * @see getShortcutsByKey(int key)
      */
-    GlobalShortcut *getShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type = KGlobalAccel::MatchType::Equal) const;
+    GlobalShortcut *getShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type = KGlobalAccel::MatchType::Equal);
 
     /**
      * Get the shortcuts corresponding to key. Active and inactive shortcuts
@@ -104,7 +119,7 @@ public:
      *
      * @see getShortcutsByKey(int key)
      */
-    QList<GlobalShortcut *> getShortcutsByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const;
+    QList<GlobalShortcut *> getShortcutsByKey(const QKeySequence &key, KGlobalAccel::MatchType type);
 
     /**
      * Checks if @p shortcut is available for @p component.
@@ -114,46 +129,210 @@ public:
      */
     bool isShortcutAvailable(const QKeySequence &shortcut, const QString &component, const QString &context) const;
 
+    /**
+     * Returns the keys of active shortcuts which are not registered because
+     * another client holds the grab of one of their keys.
+     */
+    QList<QKeySequence> contestedKeys() const;
+
+    /**
+     * Returns the shortcuts of all components in all contexts, skipping the
+     * first @p first ones and returning at most @p max, all if @p max is 0.
+     * Dormant components are loaded.
+     */
+    QList<KGlobalShortcutInfo> snapshot(qsizetype first, qsizetype max);
+
+    /**
+     * Every change of a shortcut, a context or a component advances the
+     * generation. Its high 32 bits are an epoch picked at random on startup,
+     * the low ones count the changes, so that generations of another run are
+     * never taken for ones of this run.
+     */
+    quint64 generation() const;
+
+    /**
+     * Returns all shortcuts of the components which changed after
+     * @p generation. @p components gets the names of those components,
+     * removed ones have no shortcuts in the result.
+     *
+     * @p fullResync is set if the changes since @p generation are not known
+     * anymore, the caller has to read everything again then.
+     */
+    QList<KGlobalShortcutInfo> changesSince(quint64 generation, QStringList &components, bool &fullResync);
+
+    /**
+     * Returns the handle of @p shortcut, so that clients can refer to it
+     * without looking it up by name every time. A handle stands for the
+     * names of the component, context and shortcut for as long as the
+     * registry lives, a shortcut created again with those names gets it back.
+     * Handles are never given to other names, 0 is no shortcut.
+     */
+    uint handle(const GlobalShortcut *shortcut);
+
+    //! Returns the shortcut with @p handle, nullptr if there is none with its names right now
+    GlobalShortcut *shortcutByHandle(uint handle);
+
+    /**
+     * Notes that the D-Bus client @p service on @p connection registered
+     * @p component, see Component::addClient(). It is forgotten once it
+     * leaves the bus.
+     */
+    void addClient(Component *component, const QDBusConnection &connection, const QString &service);
+
+    /**
+     * Sends the events of the shortcut with @p handle to the D-Bus client
+     * @p service on @p connection alone, as the signal
+     * shortcutEvent(handle, state, timestamp) of KGlobalAccelD, instead of
+     * emitting the signals of its component. @p service is empty for the
+     * client of a peer connection, see addPeerConnection().
+     *
+     * The subscription ends with unsubscribe() or when the client leaves the
+     * bus. It outlives the shortcut, like the handle, and applies again to a
+     * shortcut created with the same names.
+     */
+    void subscribe(uint handle, const QDBusConnection &connection, const QString &service);
+    void unsubscribe(uint handle, const QDBusConnection &connection, const QString &service);
+
+    /**
+     * Writes the events of the shortcuts with @p handles into @p channel,
+     * for the client @p service on @p connection, instead of emitting the
+     * signals of their components. A channel the client had before is
+     * closed. The channel is closed as well when the client leaves the bus.
+     */
+    void addEventChannel(const QDBusConnection &connection, const QString &service, const QList<uint> &handles, std::unique_ptr<ShortcutEventChannel> channel);
+    void removeEventChannel(const QDBusConnection &connection, const QString &service);
+
+    /**
+     * Sends the event of @p shortcut to the clients which subscribed to it
+     * or have an event channel for it. Returns false if there are none, its
+     * component has to emit it then. That is also the case while another
+     * client than the owner registered the component, which would miss the
+     * event otherwise.
+     */
+    bool sendToSubscribers(const GlobalShortcut &shortcut, ShortcutKeyState state, qlonglong timestamp);
+
     bool registerKey(const QKeySequence &key, GlobalShortcut *shortcut);
 
     void setDBusPath(const QDBusObjectPath &path);
 
+    /**
+     * Exports the components on the peer-to-peer @p connection as well, like
+     * on the session bus. The connection is forgotten once it is closed.
+     */
+    void addPeerConnection(const QDBusConnection &connection);
+
     bool unregisterKey(const QKeySequence &key, GlobalShortcut *shortcut);
 
     KGlobalAccelInterface *interface() const;
 
+    /**
+     * Long operations like loading or writing the settings and grabbing or
+     * ungrabbing all keys are split into tasks, which are run in time slices
+     * from the event loop. Every task leaves the registry in a consistent
+     * state, so key events can be handled in between.
+     *
+     * Runs all pending tasks right away. Call this before acting on the
+     * result of such an operation.
+     */
+    void finishPendingTasks();
+
+    /**
+     * Runs the pending tasks on the component @p uniqueName right away, the
+     * others stay queued. Tasks which may touch any component, and those
+     * queued before them, are run as well.
+     */
+    void finishPendingTasks(const QString &uniqueName);
+
+Q_SIGNALS:
+    /**
+     * The keys of the present shortcut @p actionId were changed in the
+     * config file by someone else.
+     */
+    void shortcutKeysReloaded(const QStringList &actionId, const QList<QKeySequence> &keys);
+
+    /**
+     * The generation advanced. Emitted at most once per event loop
+     * iteration, however many changes there were.
+     */
+    void generationChanged(quint64 generation);
+
 public Q_SLOTS:
 
     void clear();
 
+    // Load the settings, asynchronously
     void loadSettings();
 
+    // Write the settings, asynchronously
     void writeSettings();
 
-    // Grab the keys
+    // Write the settings after a short delay, collecting the changes until then
+    void scheduleWriteSettings();
+
+    // Write the settings now if scheduleWriteSettings() was called before
+    void writePendingSettings();
+
+    // Grab the keys, asynchronously
     void grabKeys();
 
-    // Ungrab the keys
+    // Ungrab the keys, asynchronously
     void ungrabKeys();
 
+    // Grab the keys of active shortcuts which could not be grabbed so far, asynchronously
+    void grabFailedKeys();
+
+    // Unregister the keys of the shortcuts using one of @p keys, which are not grabbed anymore
+    void keysLost(const QList<int> &keys);
+
 private:
     friend struct KGlobalAccelDPrivate;
     friend class Component;
+    friend class GlobalShortcut;
     friend class KGlobalAccelInterface;
 
     Component *createComponent(const QString &uniqueName, const QString &friendlyName);
     KServiceActionComponent *createServiceActionComponent(const QString &uniqueName);
     KServiceActionComponent *createServiceActionComponent(KService::Ptr service);
+    //! Creates the component for @p service and loads its shortcuts from the config or the service
+    KServiceActionComponent *loadServiceActionComponent(KService::Ptr service);
+    void loadComponentSettings(const QString &groupName);
+    void loadDormantComponent(const QString &groupName);
+
+    /**
+     * Watch kglobalshortcutsrc, so that changes made by someone else are
+     * applied without a restart. Our own writes go through syncConfig(),
+     * which remembers the hash of what was written to ignore them.
+     */
+    void watchConfigFile();
+    void syncConfig();
+    QByteArray configFileHash() const;
+    void reloadConfig();
+    void loadServiceSettings(const QString &groupName);
     void migrateConfig();
     void migrateKHotkeys();
     void scheduleRefreshServices();
     void refreshServices();
     void detectAppsWithShortcuts();
 
+    /**
+     * Watch the kglobalaccel/ data directories and the desktop files in them, so
+     * that added, changed or removed files are picked up without a rescan. As
+     * long as the user's kglobalaccel/ does not exist, its parent is watched
+     * for it to be created.
+     */
+    void watchServiceDirectories();
+    void watchedDirectoryChanged(const QString &path);
+    void serviceDirectoryChanged();
+    void serviceFileChanged(const QString &path);
+    void reloadServiceComponent(const QString &fileName);
+    void removeServiceComponent(const QString &fileName);
+
     static void unregisterComponent(Component *component);
     using ComponentPtr = std::unique_ptr<Component, decltype(&unregisterComponent)>;
 
     Component *registerComponent(ComponentPtr component);
+    //! Registers @p component on the session bus, unless that already happened
+    void exportComponent(Component *component) const;
 
     // called by the implementation to inform us about key presses
     // returns true if the key was handled
@@ -162,10 +341,37 @@ private:
     bool axisTriggered(int axis);
 
     bool processKey(int keyQt, ShortcutKeyState state);
+    /**
+     * Emits the autorepeat of @p keyQt for the held shortcut, at most once
+     * every m_minimumRepeatInterval. Returns false if @p keyQt is not the
+     * key of the held shortcut.
+     */
+    bool processRepeat(int keyQt);
+
+    /**
+     * Between these calls registerKey() and unregisterKey() only book the
+     * keys, endGrabBatch() then releases and grabs all of them with one call
+     * to KGlobalAccelInterface::grabKeysBatch() each. Sequences with a key
+     * that could not be grabbed are unregistered again.
+     */
+    void beginGrabBatch();
+    void endGrabBatch();
+
+    struct GrabBatch {
+        //! Keys which still have to be grabbed
+        QList<int> keys;
+        //! Sequences registered during the batch
+        QList<QKeySequence> sequences;
+        //! Keys which are not used anymore and still have to be released
+        QList<int> releasedKeys;
+    };
+    std::optional<GrabBatch> m_grabBatch;
 
     QHash<QKeySequence, GlobalShortcut *> _active_keys;
     QKeySequence _active_sequence;
     QHash<int, int> _keys_count;
+    //! Number of modifier-only sequences in _active_keys, those are not grabbed
+    int m_modifierOnlyShortcuts = 0;
 
     Qt::KeyboardModifiers m_currentModifiers;
     // State machine:
@@ -192,6 +398,40 @@ private:
         });
     }
 
+    //! Only searches the loaded components, unlike getShortcutByKey()
+    GlobalShortcut *findShortcutByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const;
+
+    /**
+     * A component from the config file whose application did not show up
+     * yet. None of its shortcuts is present, so all we need are its keys,
+     * for the conflict checks, and its names, for listing it.
+     *
+     * The config group stays as it is and the component is loaded from it
+     * once it is needed, see promoteDormantComponent().
+     */
+    struct DormantComponent {
+        QString uniqueName;
+        QString friendlyName;
+        //! The keys of all shortcuts in all contexts
+        QList<QKeySequence> keys;
+        //! For every key the index of its context in m_dormantContextNames
+        QList<qsizetype> keyContexts;
+    };
+    using DormantComponentVec = std::vector<DormantComponent>;
+    DormantComponentVec m_dormantComponents;
+    //! Context names of dormant components, most of them are "default"
+    QStringList m_dormantContextNames;
+
+    DormantComponentVec::iterator findDormantByName(const QString &name)
+    {
+        return std::find_if(m_dormantComponents.begin(), m_dormantComponents.end(), [&name](const DormantComponent &comp) {
+            return comp.uniqueName == name;
+        });
+    }
+    //! Loads the dormant component @p it completely and returns it
+    Component *promoteDormantComponent(DormantComponentVec::iterator it);
+    void promoteDormantComponents();
+
     KGlobalAccelInterface *_manager = nullptr;
 
     mutable KConfig _config;
@@ -232,6 +472,11 @@ private:
      */
     void loadAllowListSettings();
 
+    /**
+     * Read how often repeats of a held shortcut are emitted at most.
+     */
+    void loadRepeatSettings();
+
     /**
      * Check whether a shortcut is permitted when the allow-list is active.
      */
@@ -239,7 +484,95 @@ private:
 
     QDBusObjectPath _dbusPath;
     GlobalShortcut *m_lastShortcut = nullptr;
+    //! Started for every repeat of m_lastShortcut which was emitted
+    QElapsedTimer m_lastRepeat;
+    std::chrono::milliseconds m_minimumRepeatInterval{50};
     QTimer m_refreshServicesTimer;
+
+    /**
+     * Append @p task to the tasks run in time slices, see finishPendingTasks().
+     * @p component names the only component it touches, if there is one.
+     */
+    void queueTask(std::function<void()> task, const QString &component = QString());
+    void runPendingTasks();
+
+    struct PendingTask {
+        //! Empty if the task may touch any component
+        QString component;
+        std::function<void()> run;
+    };
+    static constexpr std::chrono::milliseconds s_pendingTasksTimeSlice{5};
+    std::deque<PendingTask> m_pendingTasks;
+    //! Set by loadSettings(), the components are loaded by tasks after that
+    bool m_settingsLoaded = false;
+    QTimer m_pendingTasksTimer;
+
+    //! Desktop files in the kglobalaccel/ data directories, file name -> path
+    QHash<QString, QString> m_serviceFiles;
+    QFileSystemWatcher m_serviceFilesWatcher;
+
+    QString m_configFilePath;
+    QByteArray m_configFileHash;
+    QFileSystemWatcher m_configFileWatcher;
+    QTimer m_reloadConfigTimer;
+    QTimer m_writeSettingsTimer;
+
+    //! Called by the components whenever something in their snapshot() changes
+    void noteComponentChanged(const QString &uniqueName);
+
+    //! The high 32 bits of every generation of this run
+    quint32 m_epoch;
+    quint64 m_generation;
+    //! Changes up to this generation are not in m_changeLog anymore
+    quint64 m_changeLogStart;
+    //! The generation of the latest change of a component, oldest first
+    std::map<quint64, QString> m_changeLog;
+    //! The other way around, component -> its generation in m_changeLog
+    QHash<QString, quint64> m_latestChanges;
+    static constexpr std::size_t s_changeLogSize = 1024;
+    //! Set while a dormant component is loaded, which changes nothing a client could see
+    bool m_promotingDormant = false;
+    QTimer m_generationTimer;
+
+    //! What a handle stands for
+    struct HandleName {
+        QString component;
+        QString context;
+        QString shortcut;
+
+        bool operator==(const HandleName &other) const = default;
+        friend size_t qHash(const HandleName &name, size_t seed = 0)
+        {
+            return qHashMulti(seed, name.component, name.context, name.shortcut);
+        }
+    };
+    static HandleName handleName(const GlobalShortcut *shortcut);
+
+    //! The names of every handle handed out, at index handle - 1
+    std::vector<HandleName> m_handleNames;
+    //! The other way around, names -> handle
+    QHash<HandleName, uint> m_handles;
+
+    void subscriberUnregistered(const QString &service);
+
+    //! Drops the subscriptions, channels and components of @p service once it leaves the bus
+    void watchSubscriber(const QDBusConnection &connection, const QString &service);
+
+    //! A client which subscribed to the events of a handle
+    using Subscriber = Component::Client;
+    QHash<uint, QList<Subscriber>> m_subscriptions;
+    //! Watches the subscribers and the clients of the components, see addClient()
+    QDBusServiceWatcher m_subscriberWatcher;
+
+    struct EventChannel {
+        Subscriber client;
+        QSet<uint> handles;
+        std::unique_ptr<ShortcutEventChannel> channel;
+    };
+    std::vector<EventChannel> m_eventChannels;
+
+    //! Names of the peer connections the components are exported on, see addPeerConnection()
+    QStringList m_peerConnections;
 };
 
 #endif /* #ifndef GLOBALSHORTCUTSREGISTRY_H */
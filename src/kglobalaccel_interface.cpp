@@ -32,6 +32,26 @@ void KGlobalAccelInterface::setRegistry(GlobalShortcutsRegistry *registry)
     d->owner = registry;
 }
 
+QList<bool> KGlobalAccelInterface::grabKeysBatch(const QList<int> &keys, bool grab)
+{
+    QList<bool> results;
+    results.reserve(keys.size());
+    for (int key : keys) {
+        results.append(grabKey(key, grab));
+    }
+    return results;
+}
+
+void KGlobalAccelInterface::setModifierOnlyShortcutsActive(bool active)
+{
+    Q_UNUSED(active)
+}
+
+QList<int> KGlobalAccelInterface::contestedKeys() const
+{
+    return {};
+}
+
 bool KGlobalAccelInterface::keyEvent(int keyQt, ShortcutKeyState state)
 {
     return d->owner->keyEvent(keyQt, state);
@@ -47,6 +67,21 @@ void KGlobalAccelInterface::ungrabKeys()
     d->owner->ungrabKeys();
 }
 
+void KGlobalAccelInterface::grabFailedKeys()
+{
+    d->owner->grabFailedKeys();
+}
+
+void KGlobalAccelInterface::keysLost(const QList<int> &keys)
+{
+    d->owner->keysLost(keys);
+}
+
+void KGlobalAccelInterface::queueTask(std::function<void()> task)
+{
+    d->owner->queueTask(std::move(task));
+}
+
 bool KGlobalAccelInterface::pointerPressed(Qt::MouseButtons buttons)
 {
     return d->owner->pointerPressed(buttons);
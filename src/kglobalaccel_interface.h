@@ -11,6 +11,8 @@
 
 #include <QObject>
 
+#include <functional>
+
 #include "kglobalacceld_export.h"
 #include "shortcutkeystate.h"
 
@@ -44,6 +46,41 @@ public:
      */
     virtual bool grabKey(int key, bool grab) = 0;
 
+    /**
+     * Grabs or releases all of @p keys, like grabKey() does for a single key.
+     *
+     * The default implementation calls grabKey() for each key. Implementations
+     * which talk to a server should override it to send all requests at once
+     * and only wait for the result of the whole batch.
+     *
+     * \param keys the Qt keycodes to grab or release.
+     * \param grab true to grab the keys, false to release them.
+     *
+     * \return for each key in @p keys true if successful, otherwise false.
+     */
+    virtual QList<bool> grabKeysBatch(const QList<int> &keys, bool grab);
+
+    /**
+     * Called when the first modifier-only shortcut becomes active and when the
+     * last one becomes inactive. Modifier-only shortcuts are not grabbed, the
+     * implementation has to watch the input for them, which it can stop doing
+     * while there are none.
+     *
+     * The default implementation does nothing.
+     *
+     * \param active true if there are active modifier-only shortcuts.
+     */
+    virtual void setModifierOnlyShortcutsActive(bool active);
+
+    /**
+     * Returns the keys which could not be grabbed because another client
+     * holds them. The implementation may wait a while before it tries to
+     * grab those again.
+     *
+     * The default implementation returns an empty list.
+     */
+    virtual QList<int> contestedKeys() const;
+
     void setRegistry(GlobalShortcutsRegistry *registry);
 
 protected:
@@ -54,6 +91,24 @@ protected:
     bool keyEvent(int keyQt, ShortcutKeyState state);
     void grabKeys();
     void ungrabKeys();
+    /**
+     * Called by the implementation to try again to grab the keys of active
+     * shortcuts which could not be grabbed so far, e.g. because they were
+     * not in the keymap.
+     */
+    void grabFailedKeys();
+    /**
+     * Called by the implementation when it does not hold a grab for @p keys
+     * anymore, e.g. because they left the keymap. The shortcuts using them
+     * are unregistered, so that grabFailedKeys() tries them again.
+     */
+    void keysLost(const QList<int> &keys);
+    /**
+     * Called by the implementation to run @p task once the work queued by
+     * grabKeys() and ungrabKeys() so far is done. Those run in time slices so
+     * that key events are not blocked by them.
+     */
+    void queueTask(std::function<void()> task);
     /**
      * Called by the implementation to inform us about pointer presses
      * Currently only used for clearing modifier only shortcuts
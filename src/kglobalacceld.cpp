@@ -19,8 +19,10 @@
 
 #include <QDBusConnection>
 #include <QDBusMetaType>
+#include <QDBusServer>
 #include <QMetaMethod>
-#include <QTimer>
+#include <QSet>
+#include <QStandardPaths>
 
 struct KGlobalAccelDPrivate {
     KGlobalAccelDPrivate(KGlobalAccelD *qq)
@@ -37,6 +39,30 @@ struct KGlobalAccelDPrivate {
      */
     GlobalShortcut *findAction(const QString &componentUnique, const QString &shortcutUnique) const;
 
+    /**
+     * Find the component @a componentUnique, with a "|context" suffix in
+     * that context, otherwise in its current one.
+     */
+    Component *findComponent(const QString &componentUnique, QString *contextUnique) const;
+
+    //! Results of findComponent(), so that a batch looks up every component only once
+    using ComponentCache = QHash<QString, std::pair<Component *, QString>>;
+    GlobalShortcut *findAction(const QStringList &actionId, ComponentCache *cache) const;
+
+    /**
+     * The work of KGlobalAccelD::doRegister() for @a shortcut, which is
+     * created if it is nullptr.
+     *
+     * @return @c true if the settings have to be written
+     */
+    bool registerAction(const QStringList &actionId, GlobalShortcut *shortcut);
+
+    /**
+     * The work of KGlobalAccelD::setShortcutKeys() for @a shortcut.
+     * @a changed is set if the settings have to be written.
+     */
+    QList<QKeySequence> setShortcutKeys(GlobalShortcut *shortcut, const QList<QKeySequence> &keys, uint flags, bool *changed);
+
     GlobalShortcut *addAction(const QStringList &actionId);
     Component *component(const QStringList &actionId) const;
 
@@ -51,13 +77,28 @@ struct KGlobalAccelDPrivate {
         }
     }
 
-    //! Timer for delayed writing to kglobalshortcutsrc
-    QTimer writeoutTimer;
+    //! Returns the registry with all its pending work done, so that calls
+    //! from clients see a consistent state
+    GlobalShortcutsRegistry *registry() const
+    {
+        m_registry->finishPendingTasks();
+        return m_registry.get();
+    }
+
+    //! Like registry(), for calls which only look at the component @p componentUnique
+    GlobalShortcutsRegistry *registry(const QString &componentUnique) const
+    {
+        m_registry->finishPendingTasks(componentUnique);
+        return m_registry.get();
+    }
 
     //! Our holder
     KGlobalAccelD *q;
 
     std::unique_ptr<GlobalShortcutsRegistry> m_registry = nullptr;
+
+    //! Started by the first call of peerAddress()
+    std::unique_ptr<QDBusServer> peerServer;
 };
 
 GlobalShortcut *KGlobalAccelDPrivate::findAction(const QStringList &actionId) const
@@ -71,24 +112,51 @@ GlobalShortcut *KGlobalAccelDPrivate::findAction(const QStringList &actionId) co
     return findAction(actionId.at(KGlobalAccel::ComponentUnique), actionId.at(KGlobalAccel::ActionUnique));
 }
 
-GlobalShortcut *KGlobalAccelDPrivate::findAction(const QString &_componentUnique, const QString &shortcutUnique) const
+Component *KGlobalAccelDPrivate::findComponent(const QString &_componentUnique, QString *contextUnique) const
 {
     QString componentUnique = _componentUnique;
 
     Component *component;
-    QString contextUnique;
     if (componentUnique.indexOf(QLatin1Char('|')) == -1) {
-        component = m_registry->getComponent(componentUnique);
+        component = registry(componentUnique)->getComponent(componentUnique);
         if (component) {
-            contextUnique = component->currentContext()->uniqueName();
+            *contextUnique = component->currentContext()->uniqueName();
         }
     } else {
-        splitComponent(componentUnique, contextUnique);
-        component = m_registry->getComponent(componentUnique);
+        splitComponent(componentUnique, *contextUnique);
+        component = registry(componentUnique)->getComponent(componentUnique);
     }
 
     if (!component) {
         qCDebug(KGLOBALACCELD) << componentUnique << "not found";
+    }
+    return component;
+}
+
+GlobalShortcut *KGlobalAccelDPrivate::findAction(const QStringList &actionId, ComponentCache *cache) const
+{
+    if (actionId.size() != 4) {
+        qCDebug(KGLOBALACCELD) << "Invalid! '" << actionId << "'";
+        return nullptr;
+    }
+
+    const QString &componentUnique = actionId.at(KGlobalAccel::ComponentUnique);
+    auto it = cache->constFind(componentUnique);
+    if (it == cache->cend()) {
+        QString contextUnique;
+        Component *component = findComponent(componentUnique, &contextUnique);
+        it = cache->insert(componentUnique, {component, contextUnique});
+    }
+
+    const auto &[component, contextUnique] = it.value();
+    return component ? component->getShortcutByName(actionId.at(KGlobalAccel::ActionUnique), contextUnique) : nullptr;
+}
+
+GlobalShortcut *KGlobalAccelDPrivate::findAction(const QString &componentUnique, const QString &shortcutUnique) const
+{
+    QString contextUnique;
+    Component *component = findComponent(componentUnique, &contextUnique);
+    if (!component) {
         return nullptr;
     }
 
@@ -107,14 +175,14 @@ Component *KGlobalAccelDPrivate::component(const QStringList &actionId) const
     const QString uniqueName = actionId.at(KGlobalAccel::ComponentUnique);
 
     // If a component for action already exists, use that...
-    if (Component *c = m_registry->getComponent(uniqueName)) {
+    if (Component *c = registry(uniqueName)->getComponent(uniqueName)) {
         return c;
     }
 
     // ... otherwise, create a new one
     const QString friendlyName = actionId.at(KGlobalAccel::ComponentFriendly);
     if (uniqueName.endsWith(QLatin1String(".desktop"))) {
-        auto *actionComp = m_registry->createServiceActionComponent(uniqueName);
+        auto *actionComp = registry(uniqueName)->createServiceActionComponent(uniqueName);
         if (!actionComp) {
             return nullptr;
         }
@@ -122,7 +190,7 @@ Component *KGlobalAccelDPrivate::component(const QStringList &actionId) const
         actionComp->loadFromService();
         return actionComp;
     } else {
-        return m_registry->createComponent(uniqueName, friendlyName);
+        return registry(uniqueName)->createComponent(uniqueName, friendlyName);
     }
 }
 
@@ -158,7 +226,7 @@ GlobalShortcut *KGlobalAccelDPrivate::addAction(const QStringList &actionId)
     return new GlobalShortcut(actionId.at(KGlobalAccel::ActionUnique),
                               actionId.at(KGlobalAccel::ActionFriendly),
                               component->shortcutContext(contextUnique),
-                              m_registry.get());
+                              registry());
 }
 
 Q_DECLARE_METATYPE(QStringList)
@@ -173,6 +241,7 @@ bool KGlobalAccelD::init()
 {
     qDBusRegisterMetaType<QKeySequence>();
     qDBusRegisterMetaType<QList<QKeySequence>>();
+    qDBusRegisterMetaType<QList<QList<QKeySequence>>>();
     qDBusRegisterMetaType<QList<QDBusObjectPath>>();
     qDBusRegisterMetaType<QList<QStringList>>();
     qDBusRegisterMetaType<QStringList>();
@@ -183,8 +252,8 @@ bool KGlobalAccelD::init()
     d->m_registry = std::make_unique<GlobalShortcutsRegistry>();
     Q_ASSERT(d->m_registry);
 
-    d->writeoutTimer.setSingleShot(true);
-    connect(&d->writeoutTimer, &QTimer::timeout, d->m_registry.get(), &GlobalShortcutsRegistry::writeSettings);
+    connect(d->m_registry.get(), &GlobalShortcutsRegistry::shortcutKeysReloaded, this, &KGlobalAccelD::yourShortcutsChanged);
+    connect(d->m_registry.get(), &GlobalShortcutsRegistry::generationChanged, this, &KGlobalAccelD::generationChanged);
 
     if (!QDBusConnection::sessionBus().registerService(QLatin1String("org.kde.kglobalaccel"))) {
         qCWarning(KGLOBALACCELD) << "Failed to register service org.kde.kglobalaccel";
@@ -204,17 +273,15 @@ bool KGlobalAccelD::init()
 
 KGlobalAccelD::~KGlobalAccelD()
 {
-    if (d->writeoutTimer.isActive()) {
-        d->writeoutTimer.stop();
-        d->m_registry->writeSettings();
-    }
+    d->m_registry->writePendingSettings();
+    d->m_registry->finishPendingTasks();
     d->m_registry->deactivateShortcuts();
     delete d;
 }
 
 QList<QStringList> KGlobalAccelD::allMainComponents() const
 {
-    return d->m_registry->allComponentNames();
+    return d->registry()->allComponentNames();
 }
 
 QList<QStringList> KGlobalAccelD::allActionsForComponent(const QStringList &actionId) const
@@ -222,7 +289,7 @@ QList<QStringList> KGlobalAccelD::allActionsForComponent(const QStringList &acti
     // ### Would it be advantageous to sort the actions by unique name?
     QList<QStringList> ret;
 
-    Component *const component = d->m_registry->getComponent(actionId[KGlobalAccel::ComponentUnique]);
+    Component *const component = d->registry(actionId[KGlobalAccel::ComponentUnique])->getComponent(actionId[KGlobalAccel::ComponentUnique]);
     if (!component) {
         return ret;
     }
@@ -247,6 +314,24 @@ QList<QStringList> KGlobalAccelD::allActionsForComponent(const QStringList &acti
     return ret;
 }
 
+QList<KGlobalShortcutInfo> KGlobalAccelD::registrySnapshot(uint first, uint max) const
+{
+    return d->registry()->snapshot(first, max);
+}
+
+qulonglong KGlobalAccelD::generation() const
+{
+    return d->registry()->generation();
+}
+
+QList<KGlobalShortcutInfo> KGlobalAccelD::changesSince(qulonglong generation, QStringList &components, qulonglong &current, bool &fullResync) const
+{
+    GlobalShortcutsRegistry *registry = d->registry();
+    QList<KGlobalShortcutInfo> shortcuts = registry->changesSince(generation, components, fullResync);
+    current = registry->generation();
+    return shortcuts;
+}
+
 #if KGLOBALACCELD_BUILD_DEPRECATED_SINCE(5, 90)
 QStringList KGlobalAccelD::action(int key) const
 {
@@ -256,7 +341,7 @@ QStringList KGlobalAccelD::action(int key) const
 
 QStringList KGlobalAccelD::actionList(const QKeySequence &key) const
 {
-    GlobalShortcut *shortcut = d->m_registry->getShortcutByKey(key);
+    GlobalShortcut *shortcut = d->registry()->getShortcutByKey(key);
     QStringList ret;
     if (shortcut) {
         ret.append(shortcut->context()->component()->uniqueName());
@@ -269,7 +354,7 @@ QStringList KGlobalAccelD::actionList(const QKeySequence &key) const
 
 void KGlobalAccelD::activateGlobalShortcutContext(const QString &component, const QString &uniqueName)
 {
-    Component *const comp = d->m_registry->getComponent(component);
+    Component *const comp = d->registry(component)->getComponent(component);
     if (comp) {
         comp->activateGlobalShortcutContext(uniqueName);
     }
@@ -277,19 +362,24 @@ void KGlobalAccelD::activateGlobalShortcutContext(const QString &component, cons
 
 QList<QDBusObjectPath> KGlobalAccelD::allComponents() const
 {
-    return d->m_registry->componentsDbusPaths();
+    return d->registry()->componentsDbusPaths();
 }
 
 void KGlobalAccelD::blockGlobalShortcuts(bool block)
 {
     qCDebug(KGLOBALACCELD) << "Block global shortcuts?" << block;
     if (block) {
-        d->m_registry->deactivateShortcuts(true);
+        d->registry()->deactivateShortcuts(true);
     } else {
-        d->m_registry->activateShortcuts();
+        d->registry()->activateShortcuts();
     }
 }
 
+QList<QKeySequence> KGlobalAccelD::contestedKeys() const
+{
+    return d->registry()->contestedKeys();
+}
+
 #if KGLOBALACCELD_BUILD_DEPRECATED_SINCE(5, 90)
 QList<int> KGlobalAccelD::shortcut(const QStringList &action) const
 {
@@ -350,30 +440,105 @@ void KGlobalAccelD::doRegister(const QStringList &actionId)
         return;
     }
 
-    GlobalShortcut *shortcut = d->findAction(actionId);
-    if (!shortcut) {
-        shortcut = d->addAction(actionId);
-    } else {
-        // a switch of locales is one common reason for a changing friendlyName
-        if ((!actionId[KGlobalAccel::ActionFriendly].isEmpty()) && shortcut->friendlyName() != actionId[KGlobalAccel::ActionFriendly]) {
-            shortcut->setFriendlyName(actionId[KGlobalAccel::ActionFriendly]);
-            scheduleWriteSettings();
+    if (d->registerAction(actionId, d->findAction(actionId))) {
+        scheduleWriteSettings();
+    }
+    addCallerAsClient({actionId});
+}
+
+void KGlobalAccelD::doRegisterBatch(const QList<QStringList> &actionIds)
+{
+    qCDebug(KGLOBALACCELD) << actionIds.size() << "actions";
+
+    GlobalShortcutsRegistry *registry = d->registry();
+    KGlobalAccelDPrivate::ComponentCache components;
+    bool changed = false;
+
+    // Keys grabbed or released on the way, e.g. by components being loaded, change together at the end
+    registry->beginGrabBatch();
+    for (const QStringList &actionId : actionIds) {
+        if (actionId.size() < 4) {
+            continue;
+        }
+
+        GlobalShortcut *shortcut = d->findAction(actionId, &components);
+        if (!shortcut) {
+            // The action may create its component or context
+            components.remove(actionId.at(KGlobalAccel::ComponentUnique));
+        }
+        changed |= d->registerAction(actionId, shortcut);
+    }
+    registry->endGrabBatch();
+
+    if (changed) {
+        scheduleWriteSettings();
+    }
+    addCallerAsClient(actionIds);
+}
+
+void KGlobalAccelD::addCallerAsClient(const QList<QStringList> &actionIds)
+{
+    if (!calledFromDBus()) {
+        return;
+    }
+
+    QSet<Component *> components;
+    for (const QStringList &actionId : actionIds) {
+        if (actionId.size() < 4) {
+            continue;
         }
-        if ((!actionId[KGlobalAccel::ComponentFriendly].isEmpty())
-            && shortcut->context()->component()->friendlyName() != actionId[KGlobalAccel::ComponentFriendly]) {
-            shortcut->context()->component()->setFriendlyName(actionId[KGlobalAccel::ComponentFriendly]);
-            scheduleWriteSettings();
+        QString contextUnique;
+        if (Component *component = d->findComponent(actionId.at(KGlobalAccel::ComponentUnique), &contextUnique)) {
+            components.insert(component);
         }
     }
+
+    GlobalShortcutsRegistry *registry = d->registry();
+    for (Component *component : std::as_const(components)) {
+        registry->addClient(component, connection(), message().service());
+    }
+}
+
+bool KGlobalAccelD::isCallerOwner(const GlobalShortcut *shortcut) const
+{
+    if (shortcut->context()->component()->owner() == Component::Client{connection().name(), message().service()}) {
+        return true;
+    }
+    qCDebug(KGLOBALACCELD) << message().service() << "does not own the action" << shortcut->uniqueName();
+    sendErrorReply(QDBusError::AccessDenied, QStringLiteral("The action %1 belongs to another client.").arg(shortcut->uniqueName()));
+    return false;
+}
+
+bool KGlobalAccelDPrivate::registerAction(const QStringList &actionId, GlobalShortcut *shortcut)
+{
+    if (!shortcut) {
+        addAction(actionId);
+        return false;
+    }
+
+    bool changed = false;
+    // a switch of locales is one common reason for a changing friendlyName
+    if ((!actionId[KGlobalAccel::ActionFriendly].isEmpty()) && shortcut->friendlyName() != actionId[KGlobalAccel::ActionFriendly]) {
+        shortcut->setFriendlyName(actionId[KGlobalAccel::ActionFriendly]);
+        changed = true;
+    }
+    if ((!actionId[KGlobalAccel::ComponentFriendly].isEmpty())
+        && shortcut->context()->component()->friendlyName() != actionId[KGlobalAccel::ComponentFriendly]) {
+        shortcut->context()->component()->setFriendlyName(actionId[KGlobalAccel::ComponentFriendly]);
+        changed = true;
+    }
+    return changed;
 }
 
 QDBusObjectPath KGlobalAccelD::getComponent(const QString &componentUnique) const
 {
     qCDebug(KGLOBALACCELD) << componentUnique;
 
-    Component *component = d->m_registry->getComponent(componentUnique);
+    GlobalShortcutsRegistry *registry = d->registry(componentUnique);
+    Component *component = registry->getComponent(componentUnique);
 
     if (component) {
+        registry->exportComponent(component);
         return component->dbusPath();
     } else {
         sendErrorReply(QStringLiteral("org.kde.kglobalaccel.NoSuchComponent"), QStringLiteral("The component '%1' doesn't exist.").arg(componentUnique));
@@ -391,7 +556,7 @@ QList<KGlobalShortcutInfo> KGlobalAccelD::getGlobalShortcutsByKey(int key) const
 QList<KGlobalShortcutInfo> KGlobalAccelD::globalShortcutsByKey(const QKeySequence &key, KGlobalAccel::MatchType type) const
 {
     qCDebug(KGLOBALACCELD) << key;
-    const QList<GlobalShortcut *> shortcuts = d->m_registry->getShortcutsByKey(key, type);
+    const QList<GlobalShortcut *> shortcuts = d->registry()->getShortcutsByKey(key, type);
 
     QList<KGlobalShortcutInfo> rc;
     rc.reserve(shortcuts.size());
@@ -415,7 +580,7 @@ bool KGlobalAccelD::globalShortcutAvailable(const QKeySequence &shortcut, const
     QString realComponent = component;
     QString context;
     d->splitComponent(realComponent, context);
-    return d->m_registry->isShortcutAvailable(shortcut, realComponent, context);
+    return d->registry()->isShortcutAvailable(shortcut, realComponent, context);
 }
 
 void KGlobalAccelD::setInactive(const QStringList &actionId)
@@ -428,6 +593,28 @@ void KGlobalAccelD::setInactive(const QStringList &actionId)
     }
 }
 
+void KGlobalAccelD::setComponentInactive(const QString &componentUnique)
+{
+    qCDebug(KGLOBALACCELD) << componentUnique;
+
+    GlobalShortcutsRegistry *registry = d->registry(componentUnique);
+    Component *component = registry->getComponent(componentUnique);
+    if (!component) {
+        return;
+    }
+
+    // All contexts, like setInactive() for each action would
+    registry->beginGrabBatch();
+    const QStringList contexts = component->getShortcutContexts();
+    for (const QString &context : contexts) {
+        const auto shortcuts = component->allShortcuts(context);
+        for (GlobalShortcut *shortcut : shortcuts) {
+            shortcut->setIsPresent(false);
+        }
+    }
+    registry->endGrabBatch();
+}
+
 bool KGlobalAccelD::unregister(const QString &componentUnique, const QString &shortcutUnique)
 {
     qCDebug(KGLOBALACCELD) << componentUnique << shortcutUnique;
@@ -477,21 +664,63 @@ QList<int> KGlobalAccelD::setShortcut(const QStringList &actionId, const QList<i
 
 QList<QKeySequence> KGlobalAccelD::setShortcutKeys(const QStringList &actionId, const QList<QKeySequence> &keys, uint flags)
 {
-    // spare the DBus framework some work
-    const bool setPresent = (flags & SetPresent);
-    const bool isAutoloading = !(flags & NoAutoloading);
-    const bool isDefault = (flags & IsDefault);
-
     GlobalShortcut *shortcut = d->findAction(actionId);
     if (!shortcut) {
         return QList<QKeySequence>();
     }
 
+    bool changed = false;
+    const QList<QKeySequence> newKeys = d->setShortcutKeys(shortcut, keys, flags, &changed);
+    if (changed) {
+        scheduleWriteSettings();
+    }
+    return newKeys;
+}
+
+QList<QList<QKeySequence>>
+KGlobalAccelD::setShortcutKeysBatch(const QList<QStringList> &actionIds, const QList<QList<QKeySequence>> &keys, const QList<uint> &flags)
+{
+    qCDebug(KGLOBALACCELD) << actionIds.size() << "actions";
+
+    if (keys.size() != actionIds.size() || flags.size() != actionIds.size()) {
+        if (calledFromDBus()) {
+            sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Expected as many keys and flags as actions"));
+        }
+        return {};
+    }
+
+    GlobalShortcutsRegistry *registry = d->registry();
+    KGlobalAccelDPrivate::ComponentCache components;
+    QList<QList<QKeySequence>> result;
+    result.reserve(actionIds.size());
+    bool changed = false;
+
+    // Every shortcut books its keys, they are grabbed and released together at the end
+    registry->beginGrabBatch();
+    for (qsizetype i = 0; i < actionIds.size(); ++i) {
+        GlobalShortcut *shortcut = d->findAction(actionIds[i], &components);
+        result.append(shortcut ? d->setShortcutKeys(shortcut, keys[i], flags[i], &changed) : QList<QKeySequence>());
+    }
+    registry->endGrabBatch();
+
+    if (changed) {
+        scheduleWriteSettings();
+    }
+    return result;
+}
+
+QList<QKeySequence> KGlobalAccelDPrivate::setShortcutKeys(GlobalShortcut *shortcut, const QList<QKeySequence> &keys, uint flags, bool *changed)
+{
+    // spare the DBus framework some work
+    const bool setPresent = (flags & KGlobalAccelD::SetPresent);
+    const bool isAutoloading = !(flags & KGlobalAccelD::NoAutoloading);
+    const bool isDefault = (flags & KGlobalAccelD::IsDefault);
+
     // default shortcuts cannot clash because they don't do anything
     if (isDefault) {
         if (shortcut->defaultKeys() != keys) {
             shortcut->setDefaultKeys(keys);
-            scheduleWriteSettings();
+            *changed = true;
         }
         return keys; // doesn't matter
     }
@@ -506,7 +735,9 @@ QList<QKeySequence> KGlobalAccelD::setShortcutKeys(const QStringList &actionId,
         return shortcut->keys();
     }
 
-    // now we are actually changing the shortcut of the action
+    // now we are actually changing the shortcut of the action. The keys
+    // are checked against those of all components, which have to be loaded.
+    registry();
     shortcut->setKeys(keys);
 
     if (setPresent) {
@@ -519,7 +750,7 @@ QList<QKeySequence> KGlobalAccelD::setShortcutKeys(const QStringList &actionId,
     //  which can never be fresh if created the usual way
     shortcut->setIsFresh(false);
 
-    scheduleWriteSettings();
+    *changed = true;
 
     return shortcut->keys();
 }
@@ -549,11 +780,147 @@ void KGlobalAccelD::setForeignShortcutKeys(const QStringList &actionId, const QL
     Q_EMIT yourShortcutsChanged(actionId, newKeys);
 }
 
-void KGlobalAccelD::scheduleWriteSettings() const
+uint KGlobalAccelD::actionHandle(const QStringList &actionId)
+{
+    GlobalShortcut *shortcut = d->findAction(actionId);
+    return shortcut ? d->registry()->handle(shortcut) : 0;
+}
+
+GlobalShortcut *KGlobalAccelD::shortcutByHandle(uint handle) const
+{
+    GlobalShortcut *shortcut = d->registry()->shortcutByHandle(handle);
+    if (!shortcut) {
+        qCDebug(KGLOBALACCELD) << "No action with handle" << handle;
+        if (calledFromDBus()) {
+            sendErrorReply(QStringLiteral("org.kde.kglobalaccel.NoSuchAction"), QStringLiteral("There is no action with the handle %1.").arg(handle));
+        }
+    }
+    return shortcut;
+}
+
+QList<QKeySequence> KGlobalAccelD::shortcutKeysByHandle(uint handle) const
+{
+    GlobalShortcut *shortcut = shortcutByHandle(handle);
+    return shortcut ? shortcut->keys() : QList<QKeySequence>();
+}
+
+QList<QKeySequence> KGlobalAccelD::setShortcutKeysByHandle(uint handle, const QList<QKeySequence> &keys, uint flags)
+{
+    GlobalShortcut *shortcut = shortcutByHandle(handle);
+    if (!shortcut) {
+        return QList<QKeySequence>();
+    }
+
+    bool changed = false;
+    const QList<QKeySequence> newKeys = d->setShortcutKeys(shortcut, keys, flags, &changed);
+    if (changed) {
+        scheduleWriteSettings();
+    }
+    return newKeys;
+}
+
+void KGlobalAccelD::setInactiveByHandle(uint handle)
+{
+    if (GlobalShortcut *shortcut = shortcutByHandle(handle)) {
+        shortcut->setIsPresent(false);
+    }
+}
+
+bool KGlobalAccelD::unregisterByHandle(uint handle)
+{
+    GlobalShortcut *shortcut = shortcutByHandle(handle);
+    if (shortcut) {
+        shortcut->unRegister();
+        scheduleWriteSettings();
+    }
+    return shortcut;
+}
+
+void KGlobalAccelD::subscribe(uint handle)
+{
+    if (!calledFromDBus()) {
+        return;
+    }
+    const GlobalShortcut *shortcut = shortcutByHandle(handle);
+    if (!shortcut || !isCallerOwner(shortcut)) {
+        return;
+    }
+    qCDebug(KGLOBALACCELD) << message().service() << "subscribes to" << handle;
+    d->registry()->subscribe(handle, connection(), message().service());
+}
+
+void KGlobalAccelD::unsubscribe(uint handle)
+{
+    if (!calledFromDBus()) {
+        return;
+    }
+    d->registry()->unsubscribe(handle, connection(), message().service());
+}
+
+QString KGlobalAccelD::peerAddress()
 {
-    if (!d->writeoutTimer.isActive()) {
-        d->writeoutTimer.start(500);
+    if (!d->peerServer) {
+        // The socket is only reachable for our user, like the session bus
+        const QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+        auto server = std::make_unique<QDBusServer>(QStringLiteral("unix:dir=") + runtimeDir);
+        if (!server->isConnected()) {
+            qCWarning(KGLOBALACCELD) << "Failed to start the peer-to-peer server:" << server->lastError().message();
+            return QString();
+        }
+
+        connect(server.get(), &QDBusServer::newConnection, this, [this](const QDBusConnection &connection) {
+            qCDebug(KGLOBALACCELD) << "New peer connection" << connection.name();
+            QDBusConnection peer(connection);
+            peer.registerObject(QStringLiteral("/kglobalaccel"), this, QDBusConnection::ExportScriptableContents);
+            d->registry()->addPeerConnection(peer);
+        });
+        d->peerServer = std::move(server);
+    }
+    return d->peerServer->address();
+}
+
+bool KGlobalAccelD::openEventChannel(const QList<uint> &handles, QDBusUnixFileDescriptor &memory, QDBusUnixFileDescriptor &notifier)
+{
+    if (!calledFromDBus() || !connection().connectionCapabilities().testFlag(QDBusConnection::UnixFileDescriptorPassing)) {
+        return false;
+    }
+
+    // Like subscribe(), for every action. Unknown handles are skipped, their actions may have been unregistered in the meantime.
+    GlobalShortcutsRegistry *registry = d->registry();
+    QList<uint> validHandles;
+    for (uint handle : handles) {
+        if (const GlobalShortcut *shortcut = registry->shortcutByHandle(handle)) {
+            if (!isCallerOwner(shortcut)) {
+                return false;
+            }
+            validHandles.append(handle);
+        }
+    }
+
+    std::unique_ptr<ShortcutEventChannel> channel = ShortcutEventChannel::create();
+    if (!channel) {
+        return false;
+    }
+
+    // The descriptors are duplicated, ours are closed with the channel
+    memory = QDBusUnixFileDescriptor(channel->memoryFd());
+    notifier = QDBusUnixFileDescriptor(channel->notifierFd());
+
+    qCDebug(KGLOBALACCELD) << message().service() << "opens an event channel for" << validHandles;
+    registry->addEventChannel(connection(), message().service(), validHandles, std::move(channel));
+    return true;
+}
+
+void KGlobalAccelD::closeEventChannel()
+{
+    if (calledFromDBus()) {
+        d->registry()->removeEventChannel(connection(), message().service());
     }
 }
 
+void KGlobalAccelD::scheduleWriteSettings() const
+{
+    d->m_registry->scheduleWriteSettings();
+}
+
 #include "moc_kglobalacceld.cpp"
@@ -17,9 +17,11 @@
 #include <KGlobalAccel>
 #include <QDBusContext>
 #include <QDBusObjectPath>
+#include <QDBusUnixFileDescriptor>
 #include <QList>
 #include <QStringList>
 
+class GlobalShortcut;
 struct KGlobalAccelDPrivate;
 
 /**
@@ -69,6 +71,46 @@ public Q_SLOTS:
 
     Q_SCRIPTABLE QList<QStringList> allActionsForComponent(const QStringList &actionId) const;
 
+    /**
+     * Returns the shortcuts of all components in all contexts, with their
+     * keys and default keys, instead of asking every component for its
+     * allShortcutInfos().
+     *
+     * Large registries can be read in pages: @p first shortcuts are skipped
+     * and at most @p max are returned, all if @p max is 0. The order is
+     * stable as long as no shortcut is added or removed.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE QList<KGlobalShortcutInfo> registrySnapshot(uint first, uint max) const;
+
+    /**
+     * Returns the current generation of the registry, which advances with
+     * every change of a shortcut. Ask for it before reading the shortcuts
+     * with registrySnapshot() and pass it to changesSince() later.
+     *
+     * The high 32 bits are picked at random whenever the daemon starts, a
+     * generation of an earlier run is never mistaken for one of this run.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE qulonglong generation() const;
+
+    /**
+     * Returns all shortcuts of the components which changed after
+     * @p generation, to replace what a client knows of them. @p components
+     * gets the names of those components, a component without shortcuts in
+     * the result was removed. @p current gets the generation to ask for next
+     * time.
+     *
+     * If the changes are not known anymore, because there were too many or
+     * @p generation is from before a restart, @p fullResync is set and the
+     * client has to read everything with registrySnapshot() again.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE QList<KGlobalShortcutInfo> changesSince(qulonglong generation, QStringList &components, qulonglong &current, bool &fullResync) const;
+
 #if KGLOBALACCELD_ENABLE_DEPRECATED_SINCE(5, 90)
     KGLOBALACCELD_DEPRECATED_VERSION(5, 90, "Use actionList(const QKeySequence&, int) instead.")
     Q_SCRIPTABLE QStringList action(int key) const;
@@ -105,6 +147,18 @@ public Q_SLOTS:
 #endif
     Q_SCRIPTABLE QList<QKeySequence> setShortcutKeys(const QStringList &actionId, const QList<QKeySequence> &keys, uint flags);
 
+    /**
+     * setShortcutKeys() for many actions at once, e.g. all actions of an
+     * application when it starts. @p keys and @p flags hold the arguments
+     * for each of @p actionIds. The keys of all actions are grabbed together
+     * and the settings are written once.
+     *
+     * @return the keys of each action, like setShortcutKeys()
+     * @since 6.7
+     */
+    Q_SCRIPTABLE QList<QList<QKeySequence>>
+    setShortcutKeysBatch(const QList<QStringList> &actionIds, const QList<QList<QKeySequence>> &keys, const QList<uint> &flags);
+
     // this is used if application A wants to change shortcuts of application B
 #if KGLOBALACCELD_ENABLE_DEPRECATED_SINCE(5, 90)
     KGLOBALACCELD_DEPRECATED_VERSION(5, 90, "Use setForeignShortcutKeys(const QStringList &, const QList<QKeySequence> &) instead.")
@@ -116,8 +170,23 @@ public Q_SLOTS:
     // conflict resolution but won't trigger.
     Q_SCRIPTABLE void setInactive(const QStringList &actionId);
 
+    /**
+     * setInactive() for all actions of @p componentUnique, in all of its
+     * contexts, with the keys released together.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE void setComponentInactive(const QString &componentUnique);
+
     Q_SCRIPTABLE void doRegister(const QStringList &actionId);
 
+    /**
+     * doRegister() for each of @p actionIds, with the settings written once.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE void doRegisterBatch(const QList<QStringList> &actionIds);
+
 #if KGLOBALACCELD_ENABLE_DEPRECATED_SINCE(4, 3)
     //! @deprecated Since 4.3, use KGlobalAccelD::unregister
     KGLOBALACCELD_DEPRECATED_VERSION(4, 3, "Use KGlobalAccelD::unregister(const QString&, const QString&")
@@ -181,6 +250,112 @@ public Q_SLOTS:
 
     Q_SCRIPTABLE void blockGlobalShortcuts(bool);
 
+    /**
+     * Returns the keys of active shortcuts which don't work because another
+     * application grabbed them first. Those are tried again from time to time.
+     */
+    Q_SCRIPTABLE QList<QKeySequence> contestedKeys() const;
+
+    /**
+     * Returns a handle for the action @p actionId, which has to be registered
+     * with doRegister() first, or 0 if there is no such action.
+     *
+     * Clients which call often can pass the handle to the ...ByHandle()
+     * methods instead of the action id, which spares looking the action up
+     * by its names every time. A handle stands for the names of the action
+     * until the daemon exits, it is never given to another action. While
+     * there is no action with those names, e.g. after unregister(), the
+     * methods reply with the error org.kde.kglobalaccel.NoSuchAction. Once
+     * the action is registered again, the handle refers to it again.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE uint actionHandle(const QStringList &actionId);
+
+    //! shortcutKeys() for the action with @p handle, see actionHandle(). @since 6.7
+    Q_SCRIPTABLE QList<QKeySequence> shortcutKeysByHandle(uint handle) const;
+
+    //! setShortcutKeys() for the action with @p handle, see actionHandle(). @since 6.7
+    Q_SCRIPTABLE QList<QKeySequence> setShortcutKeysByHandle(uint handle, const QList<QKeySequence> &keys, uint flags);
+
+    //! setInactive() for the action with @p handle, see actionHandle(). @since 6.7
+    Q_SCRIPTABLE void setInactiveByHandle(uint handle);
+
+    //! unregister() for the action with @p handle, see actionHandle(). @since 6.7
+    Q_SCRIPTABLE bool unregisterByHandle(uint handle);
+
+    /**
+     * Sends the events of the action with @p handle, see actionHandle(), to
+     * the calling client alone. They arrive as the signal
+     * org.kde.KGlobalAccel.shortcutEvent(uint handle, uint state, qlonglong timestamp)
+     * on /kglobalaccel, with a state of 0 for pressed, 1 for repeated and 2
+     * for released. The component of the action does not emit its signals
+     * for it anymore, so other clients are not woken up by its events.
+     *
+     * Only the owner of the component, the first client which registered it
+     * with doRegister() and is still on the bus, can subscribe. Others get
+     * an AccessDenied error. A client is known by the connection it calls
+     * on, the session bus or a peer connection, see peerAddress(). While
+     * other clients registered the component as well, it keeps emitting its
+     * signals and the subscription waits for them to leave.
+     *
+     * The subscription ends with unsubscribe() or when the client leaves the
+     * bus. Like the handle, it is kept while the action is unregistered and
+     * applies again once it is registered anew.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE void subscribe(uint handle);
+
+    //! Ends a subscription made with subscribe(). @since 6.7
+    Q_SCRIPTABLE void unsubscribe(uint handle);
+
+    /**
+     * Returns the address of a D-Bus server of the daemon, to be passed to
+     * QDBusConnection::connectToPeer(). /kglobalaccel and the components
+     * are exported on connections to it like on the session bus, so clients
+     * which call often or wait for shortcut events can bypass the bus
+     * daemon. Only processes of the same user can connect.
+     *
+     * Returns an empty string if the server could not be started.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE QString peerAddress();
+
+    /**
+     * Opens a channel which delivers the events of the actions with
+     * @p handles, see actionHandle(), through shared memory instead of D-Bus.
+     * Like with subscribe(), the components stop emitting their signals for
+     * those actions.
+     *
+     * @p memory gets a memfd to map. It starts with five fields: a uint32
+     * magic number 0x4b474145, a uint32 version (1), the uint32 size of a
+     * record, the uint32 number of records and a uint64 count of the records
+     * written so far. The records follow, each with a uint32 handle, a uint32
+     * state (0 pressed, 1 repeated, 2 released) and an int64 timestamp. Record
+     * n is at index n modulo the number of records. It may have been
+     * overwritten while it was read if afterwards the count of records
+     * written minus n is at least the number of records. @p notifier gets an
+     * eventfd which becomes readable when records were written.
+     *
+     * A client has one channel, opening another one closes the former. It is
+     * closed by closeEventChannel() and when the client leaves the bus.
+     *
+     * Like with subscribe(), the client has to own the components of all
+     * the actions. Otherwise nothing is opened and an AccessDenied error is
+     * returned. While other clients registered a component as well, its
+     * events are not written to the channel but emitted as signals.
+     *
+     * @return false if the system or the connection can't pass the file
+     * descriptors
+     * @since 6.7
+     */
+    Q_SCRIPTABLE bool openEventChannel(const QList<uint> &handles, QDBusUnixFileDescriptor &memory, QDBusUnixFileDescriptor &notifier);
+
+    //! Closes the channel opened with openEventChannel(). @since 6.7
+    Q_SCRIPTABLE void closeEventChannel();
+
 Q_SIGNALS:
 #if KGLOBALACCELD_ENABLE_DEPRECATED_SINCE(5, 90)
     KGLOBALACCELD_DEPRECATED_VERSION(5, 90, "Use the yourShortcutsChanged(const QStringList &, const QList<QKeySequence> &) signal instead.")
@@ -189,9 +364,34 @@ Q_SIGNALS:
 
     Q_SCRIPTABLE void yourShortcutsChanged(const QStringList &actionId, const QList<QKeySequence> &newKeys);
 
+    /**
+     * The registry changed, call changesSince() to learn how. Several changes
+     * in a row are reported once, with the latest generation.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE void generationChanged(qulonglong generation);
+
+    /**
+     * The event of an action, sent to the clients which subscribed to it,
+     * see subscribe(). It is never broadcast, it is only declared here to
+     * show up in the introspection data.
+     *
+     * @since 6.7
+     */
+    Q_SCRIPTABLE void shortcutEvent(uint handle, uint state, qlonglong timestamp);
+
 private:
     void scheduleWriteSettings() const;
 
+    //! Returns the shortcut of @p handle, replies with an error if there is none
+    GlobalShortcut *shortcutByHandle(uint handle) const;
+
+    //! Notes the client calling over D-Bus as one which registered the components of @p actionIds
+    void addCallerAsClient(const QList<QStringList> &actionIds);
+    //! Returns whether the client calling over D-Bus owns the component of @p shortcut, replies with an error if not
+    bool isCallerOwner(const GlobalShortcut *shortcut) const;
+
     KGlobalAccelDPrivate *const d;
 };
 
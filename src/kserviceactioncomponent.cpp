@@ -47,24 +47,45 @@ QString makeUniqueName(const KService::Ptr &service)
 
 KServiceActionComponent::KServiceActionComponent(KService::Ptr service, GlobalShortcutsRegistry *registry)
     : Component(makeUniqueName(service), service->name(), registry)
-    , m_service(service)
+    , m_storageId(service->storageId())
+    , m_entryPath(service->entryPath())
 {
 }
 
 KServiceActionComponent::~KServiceActionComponent() = default;
 
+KService::Ptr KServiceActionComponent::service() const
+{
+    if (KService::Ptr service = KService::serviceByStorageId(m_storageId)) {
+        return service;
+    }
+
+    // Not known to sycoca, e.g. a desktop file in kglobalaccel/
+    if (!m_entryPath.isEmpty() && QFileInfo::exists(m_entryPath)) {
+        return KService::Ptr(new KService(m_entryPath));
+    }
+
+    return {};
+}
+
 void KServiceActionComponent::emitGlobalShortcutEvent(const GlobalShortcut &shortcut, ShortcutKeyState state)
 {
     if (state != ShortcutKeyState::Pressed) {
         return;
     }
 
+    const KService::Ptr service = this->service();
+    if (!service) {
+        qCWarning(KGLOBALACCELD) << "Service" << m_storageId << "is not available anymore";
+        return;
+    }
+
     KIO::ApplicationLauncherJob *job = nullptr;
 
     if (shortcut.uniqueName() == QLatin1String("_launch")) {
-        job = new KIO::ApplicationLauncherJob(m_service);
+        job = new KIO::ApplicationLauncherJob(service);
     } else {
-        const auto actions = m_service->actions();
+        const auto actions = service->actions();
         const auto it = std::find_if(actions.cbegin(), actions.cend(), [&shortcut](const KServiceAction &action) {
             return action.name() == shortcut.uniqueName();
         });
@@ -93,18 +114,25 @@ void KServiceActionComponent::emitGlobalShortcutEvent(const GlobalShortcut &shor
 
 void KServiceActionComponent::loadFromService()
 {
-    const QString type = m_service->property<QString>(QStringLiteral("X-KDE-GlobalShortcutType"));
+    if (const KService::Ptr service = this->service()) {
+        loadFromService(service);
+    }
+}
+
+void KServiceActionComponent::loadFromService(const KService::Ptr &service)
+{
+    const QString type = service->property<QString>(QStringLiteral("X-KDE-GlobalShortcutType"));
 
     // Type can be Application or Service
     // For applications add a lauch shortcut
     // If no type is set assume Application
     if (type.isEmpty() || type == QLatin1String("Application")) {
-        const QString shortcutString = m_service->property<QStringList>(QStringLiteral("X-KDE-Shortcuts")).join(QLatin1Char('\t'));
-        GlobalShortcut *shortcut = registerShortcut(QStringLiteral("_launch"), m_service->name(), shortcutString, shortcutString);
+        const QString shortcutString = service->property<QStringList>(QStringLiteral("X-KDE-Shortcuts")).join(QLatin1Char('\t'));
+        GlobalShortcut *shortcut = registerShortcut(QStringLiteral("_launch"), service->name(), shortcutString, shortcutString);
         shortcut->setIsPresent(true);
     }
 
-    const auto lstActions = m_service->actions();
+    const auto lstActions = service->actions();
     for (const KServiceAction &action : lstActions) {
         const QString shortcutString = action.property<QStringList>(QStringLiteral("X-KDE-Shortcuts")).join(QLatin1Char('\t'));
         GlobalShortcut *shortcut = registerShortcut(action.name(), action.text(), shortcutString, shortcutString);
@@ -156,9 +184,16 @@ void KServiceActionComponent::writeSettings(KConfigGroup &config) const
 }
 
 void KServiceActionComponent::loadSettings(const KConfigGroup &configGroup)
+{
+    if (const KService::Ptr service = this->service()) {
+        loadSettings(configGroup, service);
+    }
+}
+
+void KServiceActionComponent::loadSettings(const KConfigGroup &configGroup, const KService::Ptr &service)
 {
     // Action shortcuts
-    const auto actions = m_service->actions();
+    const auto actions = service->actions();
     for (const KServiceAction &action : actions) {
         const QString defaultShortcutString = action.property<QString>(QStringLiteral("X-KDE-Shortcuts")).replace(QLatin1Char(','), QLatin1Char('\t'));
         const QString shortcutString = configGroup.readEntry(action.name(), defaultShortcutString);
@@ -167,17 +202,29 @@ void KServiceActionComponent::loadSettings(const KConfigGroup &configGroup)
         shortcut->setIsPresent(true);
     }
 
-    const QString type = m_service->property<QString>(QStringLiteral("X-KDE-GlobalShortcutType"));
+    const QString type = service->property<QString>(QStringLiteral("X-KDE-GlobalShortcutType"));
 
     // Type can be Application or Service
     // For applications add a lauch shortcut
     // If no type is set assume Application
     if (type.isEmpty() || type == QLatin1String("Application")) {
-        const QString defaultShortcutString = m_service->property<QString>(QStringLiteral("X-KDE-Shortcuts")).replace(QLatin1Char(','), QLatin1Char('\t'));
+        const QString defaultShortcutString = service->property<QString>(QStringLiteral("X-KDE-Shortcuts")).replace(QLatin1Char(','), QLatin1Char('\t'));
         const QString shortcutString = configGroup.readEntry("_launch", defaultShortcutString);
-        GlobalShortcut *shortcut = registerShortcut(QStringLiteral("_launch"), m_service->name(), shortcutString, defaultShortcutString);
+        GlobalShortcut *shortcut = registerShortcut(QStringLiteral("_launch"), service->name(), shortcutString, defaultShortcutString);
         shortcut->setIsPresent(true);
     }
 }
 
+void KServiceActionComponent::reloadSettings(const KConfigGroup &configGroup, KeyChanges &keyChanges)
+{
+    // The actions come from the service, the config only holds the keys the user changed
+    const auto shortcuts = allShortcuts();
+    for (GlobalShortcut *shortcut : shortcuts) {
+        const QList<QKeySequence> keys = keysFromString(configGroup.readEntry(shortcut->uniqueName(), stringFromKeys(shortcut->defaultKeys())));
+        if (shortcut->keys() != keys) {
+            keyChanges.append({shortcut, keys});
+        }
+    }
+}
+
 #include "moc_kserviceactioncomponent.cpp"
@@ -25,9 +25,13 @@ public:
     ~KServiceActionComponent() override;
 
     void loadFromService();
+    //! Returns the service, it is looked up again on every call
+    KService::Ptr service() const;
+
     void emitGlobalShortcutEvent(const GlobalShortcut &shortcut, ShortcutKeyState state) override;
     void writeSettings(KConfigGroup &config) const override;
     void loadSettings(const KConfigGroup &config) override;
+    void reloadSettings(const KConfigGroup &config, KeyChanges &keyChanges) override;
     bool cleanUp() override;
 
 private:
@@ -36,7 +40,14 @@ private:
     //! a KServiceActionComponent, use GlobalShortcutsRegistry::self()->createServiceActionComponent().
     KServiceActionComponent(KService::Ptr service, GlobalShortcutsRegistry *registry);
 
-    KService::Ptr m_service;
+    //! Same as above, for when the caller already holds the service
+    void loadFromService(const KService::Ptr &service);
+    void loadSettings(const KConfigGroup &config, const KService::Ptr &service);
+
+    // Only what is needed to find the service again. The service itself is not kept
+    // around, most of these shortcuts are never triggered.
+    QString m_storageId;
+    QString m_entryPath;
 };
 
 #endif /* #ifndef KSERVICEACTIONCOMPONENT_H */
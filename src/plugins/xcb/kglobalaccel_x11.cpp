@@ -7,21 +7,27 @@
 */
 
 #include "kglobalaccel_x11.h"
+#include "xrecordreader.h"
 
+#include "config-kglobalaccel.h"
 #include "logging.h"
 #include <KKeyServer>
 #include <netwm.h>
 
 #include <QDebug>
-#include <QSocketNotifier>
+#include <QSet>
 
 #include <QApplication>
+#include <QCryptographicHash>
 #include <QTimer>
 #include <QWidget>
 #include <private/qtx11extras_p.h>
 
 #include <X11/keysym.h>
 
+#include <optional>
+
+
 // xcb
 
 // It uses "explicit" as a variable name, which is not allowed in C++
@@ -31,6 +37,9 @@
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xcbext.h>
 #include <xcb/xkb.h>
+#if HAVE_XCB_XINPUT
+#include <xcb/xinput.h>
+#endif
 #undef explicit
 
 // g_keyModMaskXAccel
@@ -50,6 +59,8 @@ static void calculateGrabMasks()
     //	<< "g_keyModMaskXOnOrOff = " << g_keyModMaskXOnOrOff << endl;
 }
 
+static bool isModifierKey(int keyQt);
+
 //----------------------------------------------------
 
 KGlobalAccelImpl::KGlobalAccelImpl(QObject *parent)
@@ -67,163 +78,412 @@ KGlobalAccelImpl::KGlobalAccelImpl(QObject *parent)
         m_xkb_first_event = reply->first_event;
     }
 
-    // We use XRecord to get events XCB_KEY_PRESS, XCB_KEY_RELEASE, XCB_BUTTON_PRESS
-    // This is needed to correctly handle modifier-only shortcuts, so that they don't trigger
-    // on Mod+Click, or Mod+Key; release Key; release Mod
-    // We also handle the events here, instead of in the nativeEventFilter
+    // The input of all clients is needed for modifier-only shortcuts, so that
+    // they don't trigger on Mod+Click, or Mod+Key; release Key; release Mod.
+    // By default it is recorded through XRecord on a thread of its own, see
+    // XRecordReader. XInput2 raw events on the main connection can be used
+    // instead. Either is only enabled while it is needed, see updateRecording().
+    // The record context is there in both cases, the keyboard grabs of other
+    // clients are only seen through it.
+    const QByteArray inputMonitor = qgetenv("KGLOBALACCELD_X11_INPUT");
+#if HAVE_XCB_XINPUT
+    initXInput2();
+    m_xiRawEvents = m_xiOpcode && inputMonitor == "xinput2";
+#endif
+    if (inputMonitor != "xrecord" && !inputMonitor.isEmpty() && !m_xiRawEvents) {
+        qCWarning(KGLOBALACCELD) << "Unsupported KGLOBALACCELD_X11_INPUT" << inputMonitor << ", using XRecord";
+    }
     m_display = XOpenDisplay(nullptr);
-    auto connection = xcb_connect(XDisplayString((Display *)m_display), nullptr);
-    auto context = xcb_generate_id(connection);
-    xcb_record_range_t range;
-    memset(&range, 0, sizeof(range));
-    range.device_events.first = XCB_KEY_PRESS;
-    range.device_events.last = XCB_BUTTON_PRESS;
-    range.core_requests.first = XCB_GRAB_KEYBOARD;
-    range.core_requests.last = XCB_UNGRAB_KEYBOARD;
-    xcb_record_client_spec_t cs = XCB_RECORD_CS_ALL_CLIENTS;
-    xcb_record_create_context(connection, context, 0, 1, 1, &cs, &range);
-    auto cookie = xcb_record_enable_context(connection, context);
-    xcb_flush(connection);
-
-    m_xrecordCookieSequence = cookie.sequence;
-
-    auto m_notifier = new QSocketNotifier(xcb_get_file_descriptor(connection), QSocketNotifier::Read, this);
-    connect(m_notifier, &QSocketNotifier::activated, this, [this, connection] {
-        xcb_generic_event_t *event;
-        while ((event = xcb_poll_for_event(connection))) {
-            std::free(event);
-        }
-
-        xcb_record_enable_context_reply_t *reply = nullptr;
-        xcb_generic_error_t *error = nullptr;
-        while (m_xrecordCookieSequence && xcb_poll_for_reply(connection, m_xrecordCookieSequence, (void **)&reply, &error)) {
-            // xcb_poll_for_reply may set both reply and error to null if connection has error.
-            // break if xcb_connection has error, no point to continue anyway.
-            if (xcb_connection_has_error(connection)) {
-                break;
-            }
-
-            if (error) {
-                std::free(error);
-                break;
-            }
-
-            if (!reply) {
-                continue;
-            }
-
-            QScopedPointer<xcb_record_enable_context_reply_t, QScopedPointerPodDeleter> data(reinterpret_cast<xcb_record_enable_context_reply_t *>(reply));
-            uint8_t *events = xcb_record_enable_context_data(reply);
-            uint8_t *const eventsEnd = events + xcb_record_enable_context_data_length(reply);
-            while (events < eventsEnd) {
-                qCDebug(KGLOBALACCELD) << "Got XKeyRelease event";
-                switch (*events) {
-                case XCB_KEY_PRESS: {
-                    // only handle modifier keys here, so as not to trigger when
-                    // event is grabbed by other clients; handle normal keys in
-                    // nativeEventFilter
-                    xcb_key_press_event_t *keyPressEvent = reinterpret_cast<xcb_key_press_event_t *>(events);
-                    events += sizeof(xcb_key_press_event_t);
-                    if (m_keyboardGrabbed) {
-                        break;
-                    }
-                    int keyQt;
-                    if (!KKeyServer::xcbKeyPressEventToQt(keyPressEvent, &keyQt)) {
-                        qCWarning(KGLOBALACCELD) << "KKeyServer::xcbKeyPressEventToQt failed";
-                        break;
-                    }
-                    switch (keyQt & ~Qt::KeyboardModifierMask) {
-                    case Qt::Key_Shift:
-                    case Qt::Key_Control:
-                    case Qt::Key_Alt:
-                    case Qt::Key_Super_L:
-                    case Qt::Key_Super_R:
-                    case Qt::Key_Meta:
-                        x11KeyPress(keyPressEvent);
-                        break;
-                    default:
-                        // even though we don't handle the key, we need to update the state machine
-                        resetModifierOnlyState();
-                        break;
-                    }
-                } break;
-                case XCB_KEY_RELEASE: {
-                    xcb_key_press_event_t *keyReleaseEvent = reinterpret_cast<xcb_key_press_event_t *>(events);
-                    events += sizeof(xcb_key_release_event_t);
-                    if (m_keyboardGrabbed) {
-                        break;
-                    }
-                    x11KeyRelease(keyReleaseEvent);
-                } break;
-                case XCB_BUTTON_PRESS: {
-                    xcb_button_press_event_t *buttonPressEvent = reinterpret_cast<xcb_button_press_event_t *>(events);
-                    x11ButtonPress(buttonPressEvent);
-                    events += sizeof(xcb_button_press_event_t);
-                } break;
-                case XCB_UNGRAB_KEYBOARD:
-                    m_keyboardGrabbed = false;
-                    events += sizeof(xcb_ungrab_keyboard_request_t);
-                    break;
-                case XCB_GRAB_KEYBOARD:
-                    m_keyboardGrabbed = true;
-                    events += sizeof(xcb_grab_keyboard_request_t);
-                    break;
-                default:
-                    // Impossible
-                    Q_UNREACHABLE();
-                    qCWarning(KGLOBALACCELD) << "Got unknown event type" << *events;
-                    events = eventsEnd; // exit the while loop
-                    break;
-                }
-            }
-        }
-    });
-    m_notifier->setEnabled(true);
+    m_recordReader = std::make_unique<XRecordReader>(XDisplayString((Display *)m_display));
+    if (!m_xiRawEvents) {
+        connect(m_recordReader.get(), &XRecordReader::eventsAvailable, this, &KGlobalAccelImpl::processRecordedEvents);
+        connect(m_recordReader.get(), &XRecordReader::timeRecorded, this, &KGlobalAccelImpl::processRecordedEvents);
+    }
 
     calculateGrabMasks();
+    m_keymapFingerprint = keymapFingerprint();
 
     m_remapTimer = new QTimer(this);
     m_remapTimer->setSingleShot(true);
     connect(m_remapTimer, &QTimer::timeout, this, &KGlobalAccelImpl::x11MappingNotify);
 
+    m_pendingPressTimer = new QTimer(this);
+    m_pendingPressTimer->setSingleShot(true);
+    m_pendingPressTimer->setInterval(s_recordedTimeout);
+    connect(m_pendingPressTimer, &QTimer::timeout, this, [this] {
+        qCWarning(KGLOBALACCELD) << "XRecord didn't catch up with the key press at" << m_pendingPress->time;
+        processRecordedEvents();
+        finishPendingPress();
+    });
+
+    m_contestedRetryTimer = new QTimer(this);
+    m_contestedRetryTimer->setSingleShot(true);
+    connect(m_contestedRetryTimer, &QTimer::timeout, this, [this] {
+        grabFailedKeys();
+    });
+
     qApp->installNativeEventFilter(this);
+
+    if (m_recordReader && m_recordReader->isValid()) {
+        updateRecordedKeyCodes();
+        m_recordReader->start();
+    }
 }
 
 KGlobalAccelImpl::~KGlobalAccelImpl()
 {
-    XCloseDisplay((Display *)m_display);
+    m_recordReader.reset();
+    if (m_display) {
+        XCloseDisplay((Display *)m_display);
+    }
     if (m_keySymbols) {
         xcb_key_symbols_free(m_keySymbols);
     }
 }
 
-bool KGlobalAccelImpl::grabKey(int keyQt, bool grab)
+static bool isModifierKey(int keyQt)
 {
-    // don't grab modifier only keys
     switch (keyQt & ~Qt::KeyboardModifierMask) {
     case Qt::Key_Shift:
     case Qt::Key_Control:
     case Qt::Key_Alt:
-    case Qt::Key_Meta:
     case Qt::Key_Super_L:
     case Qt::Key_Super_R:
-    case 0:
+    case Qt::Key_Meta:
+        return true;
+    default:
         return false;
     }
-    // grabKey is called during shutdown
-    // shutdown might be due to the X server being killed
-    // if so, fail immediately before trying to make other xcb calls
-    if (!QX11Info::connection() || xcb_connection_has_error(QX11Info::connection())) {
-        return false;
+}
+
+bool KGlobalAccelImpl::keyPressEventToQt(xcb_key_press_event_t *event, int *keyQt)
+{
+    // The pointer buttons don't change the key, everything else in the state might
+    constexpr uint16_t buttonMask = XCB_KEY_BUT_MASK_BUTTON_1 | XCB_KEY_BUT_MASK_BUTTON_2 | XCB_KEY_BUT_MASK_BUTTON_3 | XCB_KEY_BUT_MASK_BUTTON_4
+        | XCB_KEY_BUT_MASK_BUTTON_5;
+    const quint32 decodeKey = (quint32(event->detail) << 16) | (event->state & ~buttonMask);
+
+    auto it = m_decodedKeys.constFind(decodeKey);
+    if (it == m_decodedKeys.cend()) {
+        int decoded;
+        if (!KKeyServer::xcbKeyPressEventToQt(event, &decoded)) {
+            decoded = 0;
+        }
+        it = m_decodedKeys.insert(decodeKey, decoded);
+    }
+
+    *keyQt = it.value();
+    return *keyQt != 0;
+}
+
+void KGlobalAccelImpl::updateRecordedKeyCodes()
+{
+    if (!m_recordReader || !m_recordReader->isValid()) {
+        return;
     }
 
     if (!m_keySymbols) {
-        m_keySymbols = xcb_key_symbols_alloc(QX11Info::connection());
-        if (!m_keySymbols) {
-            return false;
+        xcb_connection_t *c = QX11Info::connection();
+        if (!c || xcb_connection_has_error(c) || !(m_keySymbols = xcb_key_symbols_alloc(c))) {
+            return;
         }
     }
 
+    // Everything which can produce a modifier key, on any level, e.g. Shift+Alt is Meta in many layouts
+    XRecordReader::KeyCodes modifierKeyCodes;
+    for (xcb_keysym_t sym : {XK_Shift_L, XK_Shift_R, XK_Control_L, XK_Control_R, XK_Alt_L, XK_Alt_R, XK_Meta_L, XK_Meta_R, XK_Super_L, XK_Super_R}) {
+        xcb_keycode_t *keyCodes = xcb_key_symbols_get_keycode(m_keySymbols, sym);
+        if (!keyCodes) {
+            continue;
+        }
+        for (int i = 0; keyCodes[i] != XCB_NO_SYMBOL; ++i) {
+            modifierKeyCodes.set(keyCodes[i]);
+        }
+        free(keyCodes);
+    }
+    m_recordReader->setModifierKeyCodes(modifierKeyCodes);
+
+    // The release of a grabbed key ends its shortcut
+    XRecordReader::KeyCodes releaseKeyCodes;
+    for (auto it = m_grabbedTargets.cbegin(); it != m_grabbedTargets.cend(); ++it) {
+        releaseKeyCodes.set(it.key().keyCode);
+    }
+    m_recordReader->setReleaseKeyCodes(releaseKeyCodes);
+}
+
+void KGlobalAccelImpl::processRecordedEvents()
+{
+    XRecordReader::Event recorded;
+    while (m_recordReader->takeEvent(&recorded)) {
+        // The input after a pending press happened after it, the X server time wraps around after 49 days
+        if (m_pendingPress && int32_t(recorded.time - m_pendingPress->time) > 0) {
+            finishPendingPress();
+        }
+        handleRecordedEvent(recorded);
+    }
+
+    if (m_pendingPress && m_recordReader->isTimeRecorded(m_pendingPress->time)) {
+        finishPendingPress();
+    }
+}
+
+void KGlobalAccelImpl::finishPendingPress()
+{
+    if (!m_pendingPress) {
+        return;
+    }
+    m_pendingPressTimer->stop();
+    xcb_key_press_event_t keyPress = *m_pendingPress;
+    m_pendingPress.reset();
+
+    const bool repeat = keyPress.detail == m_pressedKeyCode;
+    m_pressedKeyCode = keyPress.detail;
+    reportKeyPress(&keyPress, repeat ? ShortcutKeyState::Repeated : ShortcutKeyState::Pressed);
+}
+
+void KGlobalAccelImpl::handleRecordedEvent(const XRecordReader::Event &recorded)
+{
+    if (recorded.type == XRecordReader::Event::Reset) {
+        resetModifierOnlyState();
+        return;
+    }
+
+    xcb_key_press_event_t event;
+    memset(&event, 0, sizeof(event));
+    event.response_type = recorded.type == XRecordReader::Event::KeyPress ? XCB_KEY_PRESS : XCB_KEY_RELEASE;
+    event.detail = recorded.keyCode;
+    event.state = recorded.state;
+
+    if (recorded.type == XRecordReader::Event::KeyRelease) {
+        if (recorded.keyCode == m_pressedKeyCode) {
+            m_pressedKeyCode = 0;
+        }
+        x11KeyRelease(&event);
+        int keyQt;
+        // A pending press is held as well, the release is of the press before it
+        if (m_shortcutHeld && !m_pendingPress && keyPressEventToQt(&event, &keyQt) && !isModifierKey(keyQt)) {
+            m_shortcutHeld = false;
+            m_pressedKeyCode = 0;
+            updateRecording();
+        }
+        return;
+    }
+
+    // only handle modifier keys here, so as not to trigger when
+    // event is grabbed by other clients; handle normal keys in
+    // nativeEventFilter
+    int keyQt;
+    if (!keyPressEventToQt(&event, &keyQt)) {
+        qCWarning(KGLOBALACCELD) << "KKeyServer::xcbKeyPressEventToQt failed";
+        return;
+    }
+    if (isModifierKey(keyQt)) {
+        x11KeyPress(&event);
+    } else {
+        // even though we don't handle the key, we need to update the state machine
+        resetModifierOnlyState();
+    }
+}
+
+#if HAVE_XCB_XINPUT
+void KGlobalAccelImpl::initXInput2()
+{
+    xcb_connection_t *c = QX11Info::connection();
+    const xcb_query_extension_reply_t *extension = xcb_get_extension_data(c, &xcb_input_id);
+    if (!extension || !extension->present) {
+        return;
+    }
+
+    // Qt usually announced its version on this connection already, asking
+    // for a different one then fails with BadValue, which is fine as well.
+    // Raw events don't tell when another client grabbed the keyboard, since
+    // 2.1 they are sent regardless of grabs. See isKeyboardGrabbedByOthers().
+    xcb_generic_error_t *error = nullptr;
+    QScopedPointer<xcb_input_xi_query_version_reply_t, QScopedPointerPodDeleter> version(
+        xcb_input_xi_query_version_reply(c, xcb_input_xi_query_version(c, 2, 2), &error));
+    QScopedPointer<xcb_generic_error_t, QScopedPointerPodDeleter> errorGuard(error);
+    if (version ? version->major_version < 2 : (!error || error->error_code != XCB_VALUE)) {
+        return;
+    }
+
+    m_xiOpcode = extension->major_opcode;
+    qCDebug(KGLOBALACCELD) << "Using XInput2 passive grabs";
+}
+
+void KGlobalAccelImpl::selectXInput2RawEvents(bool select)
+{
+    if (m_xiSelected == select) {
+        return;
+    }
+    m_xiSelected = select;
+    m_xiModifiers.clear();
+    m_xiModifierPressed = false;
+
+    struct {
+        xcb_input_event_mask_t head;
+        uint32_t mask;
+    } mask;
+    // Only for the master devices, Qt selects events for all devices on the
+    // root window, which would be replaced otherwise
+    mask.head.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+    mask.head.mask_len = 1;
+    mask.mask = select ? XCB_INPUT_XI_EVENT_MASK_RAW_KEY_PRESS | XCB_INPUT_XI_EVENT_MASK_RAW_KEY_RELEASE | XCB_INPUT_XI_EVENT_MASK_RAW_BUTTON_PRESS : 0;
+
+    xcb_connection_t *c = QX11Info::connection();
+    xcb_input_xi_select_events(c, QX11Info::appRootWindow(), 1, &mask.head);
+    xcb_flush(c);
+}
+
+bool KGlobalAccelImpl::handleXInput2Event(xcb_ge_generic_event_t *event)
+{
+    switch (event->event_type) {
+    case XCB_INPUT_KEY_PRESS: {
+        // One of our passive grabs activated, see sendGrabs()
+        auto xiEvent = reinterpret_cast<xcb_input_key_press_event_t *>(event);
+        qCDebug(KGLOBALACCELD) << "Got XI_KeyPress event";
+        m_shortcutHeld = true;
+        updateRecording();
+        m_pressedKeyCode = xiEvent->detail;
+        const bool repeat = xiEvent->flags & XCB_INPUT_KEY_EVENT_FLAGS_KEY_REPEAT;
+
+        xcb_key_press_event_t keyPress;
+        memset(&keyPress, 0, sizeof(keyPress));
+        keyPress.response_type = XCB_KEY_PRESS;
+        keyPress.detail = xiEvent->detail;
+        keyPress.time = xiEvent->time;
+        keyPress.root = xiEvent->root;
+        keyPress.event = xiEvent->event;
+        keyPress.child = xiEvent->child;
+        // The core state has the XKB group in bits 13 and 14
+        keyPress.state = (xiEvent->mods.effective & 0xff) | ((xiEvent->group.effective & 0x3) << 13);
+        return x11KeyPress(&keyPress, xiEvent->deviceid, repeat ? ShortcutKeyState::Repeated : ShortcutKeyState::Pressed);
+    }
+    case XCB_INPUT_RAW_KEY_PRESS:
+    case XCB_INPUT_RAW_KEY_RELEASE: {
+        const bool press = event->event_type == XCB_INPUT_RAW_KEY_PRESS;
+        auto rawEvent = reinterpret_cast<xcb_input_raw_key_press_event_t *>(event);
+        const uint8_t keyCode = rawEvent->detail;
+
+        // Raw events come without the modifier state, it is made up from the
+        // modifier keys seen so far. Like with core events it doesn't contain
+        // the key of the event itself.
+        uint16_t state = 0;
+        for (auto it = m_xiModifiers.cbegin(); it != m_xiModifiers.cend(); ++it) {
+            state |= it.value();
+        }
+
+        // The release of a modifier right after its press triggers a
+        // modifier-only shortcut, which must not happen while e.g. a screen
+        // locker has the keyboard
+        if (!press && m_xiModifierPressed && m_xiModifiers.contains(keyCode) && isKeyboardGrabbedByOthers()) {
+            handleRecordedEvent({XRecordReader::Event::Reset, 0, 0, 0});
+        }
+        m_xiModifierPressed = false;
+
+        handleRecordedEvent({press ? XRecordReader::Event::KeyPress : XRecordReader::Event::KeyRelease, keyCode, state, rawEvent->time});
+
+        if (!press) {
+            m_xiModifiers.remove(keyCode);
+            break;
+        }
+
+        xcb_key_press_event_t keyPress;
+        memset(&keyPress, 0, sizeof(keyPress));
+        keyPress.detail = keyCode;
+        int keyQt;
+        if (keyPressEventToQt(&keyPress, &keyQt)) {
+            switch (keyQt & ~Qt::KeyboardModifierMask) {
+            case Qt::Key_Shift:
+                m_xiModifiers.insert(keyCode, KKeyServer::modXShift());
+                break;
+            case Qt::Key_Control:
+                m_xiModifiers.insert(keyCode, KKeyServer::modXCtrl());
+                break;
+            case Qt::Key_Alt:
+                m_xiModifiers.insert(keyCode, KKeyServer::modXAlt());
+                break;
+            case Qt::Key_Super_L:
+            case Qt::Key_Super_R:
+            case Qt::Key_Meta:
+                m_xiModifiers.insert(keyCode, KKeyServer::modXMeta());
+                break;
+            }
+            m_xiModifierPressed = m_xiModifiers.contains(keyCode);
+        }
+        break;
+    }
+    case XCB_INPUT_RAW_BUTTON_PRESS:
+        m_xiModifierPressed = false;
+        handleRecordedEvent({XRecordReader::Event::Reset, 0, 0, 0});
+        break;
+    default:
+        break;
+    }
+    return false;
+}
+
+bool KGlobalAccelImpl::isKeyboardGrabbedByOthers() const
+{
+    // The record context sees the GrabKeyboard and UngrabKeyboard requests of
+    // all clients, even while it doesn't record the input. It reads them on
+    // another connection, a grab sent just before the release may not have
+    // arrived yet.
+    return m_recordReader && m_recordReader->isKeyboardGrabbed();
+}
+#endif
+
+bool KGlobalAccelImpl::grabKey(int keyQt, bool grab)
+{
+    return grabKeysBatch({keyQt}, grab).constFirst();
+}
+
+void KGlobalAccelImpl::setModifierOnlyShortcutsActive(bool active)
+{
+    m_modifierOnlyShortcutsActive = active;
+    updateRecording();
+}
+
+void KGlobalAccelImpl::updateRecording()
+{
+    const bool enabled = m_modifierOnlyShortcutsActive || m_shortcutHeld;
+    if (m_xiRawEvents) {
+#if HAVE_XCB_XINPUT
+        selectXInput2RawEvents(enabled);
+#endif
+    } else if (m_recordReader) {
+        m_recordReader->setEnabled(enabled);
+    }
+}
+
+bool KGlobalAccelImpl::resolveGrabTargets(int keyQt, QList<GrabTarget> *targets)
+{
+    // The same keys are resolved again and again, e.g. on every context switch,
+    // but the result only changes with the keymap
+    auto it = m_resolvedKeys.constFind(keyQt);
+    if (it == m_resolvedKeys.cend()) {
+        QList<GrabTarget> resolved;
+        lookupGrabTargets(keyQt, &resolved);
+        it = m_resolvedKeys.insert(keyQt, resolved);
+    }
+
+    *targets = it.value();
+    return !targets->isEmpty();
+}
+
+bool KGlobalAccelImpl::lookupGrabTargets(int keyQt, QList<GrabTarget> *targets)
+{
+    // don't grab modifier only keys
+    switch (keyQt & ~Qt::KeyboardModifierMask) {
+    case Qt::Key_Shift:
+    case Qt::Key_Control:
+    case Qt::Key_Alt:
+    case Qt::Key_Meta:
+    case Qt::Key_Super_L:
+    case Qt::Key_Super_R:
+    case 0:
+        return false;
+    }
+
     if (!keyQt) {
         qCDebug(KGLOBALACCELD) << "Tried to grab key with null code.";
         return false;
@@ -256,10 +516,15 @@ bool KGlobalAccelImpl::grabKey(int keyQt, bool grab)
     if (!keyCodes) {
         return false;
     }
-    int i = 0;
-    bool success = !grab;
-    while (keyCodes[i] != XCB_NO_SYMBOL) {
-        xcb_keycode_t keyCodeX = keyCodes[i++];
+
+    for (int i = 0; keyCodes[i] != XCB_NO_SYMBOL; ++i) {
+        const xcb_keycode_t keyCodeX = keyCodes[i];
+        if (!keyCodeX) {
+            qCDebug(KGLOBALACCELD) << "keyQt (0x" << Qt::hex << keyQt << ") was resolved to x11 keycode 0";
+            continue;
+        }
+
+        uint modX = keyModX;
 
         // Check if shift needs to be added to the grab since KKeySequenceWidget
         // can remove shift for some keys. (all the %&* and such)
@@ -270,71 +535,322 @@ bool KGlobalAccelImpl::grabKey(int keyQt, bool grab)
             && keySymX != xcb_key_symbols_get_keysym(m_keySymbols, keyCodeX, 0)
             && keySymX == xcb_key_symbols_get_keysym(m_keySymbols, keyCodeX, 1)) { /* clang-format on */
             qCDebug(KGLOBALACCELD) << "adding shift to the grab";
-            keyModX |= KKeyServer::modXShift();
+            modX |= KKeyServer::modXShift();
         }
 
-        keyModX &= g_keyModMaskXAccel; // Get rid of any non-relevant bits in mod
+        modX &= g_keyModMaskXAccel; // Get rid of any non-relevant bits in mod
 
-        if (!keyCodeX) {
-            qCDebug(KGLOBALACCELD) << "keyQt (0x" << Qt::hex << keyQt << ") was resolved to x11 keycode 0";
-            continue;
+        targets->append({keyCodeX, modX});
+    }
+    free(keyCodes);
+
+    return !targets->isEmpty();
+}
+
+// We'll have to grab 8 key modifier combinations in order to cover all
+//  combinations of CapsLock, NumLock, ScrollLock.
+// Does anyone with more X-savvy know how to set a mask on QX11Info::appRootWindow so that
+//  the irrelevant bits are always ignored and we can just make one XGrabKey
+//  call per accelerator? -- ellis
+template<typename Func>
+static void forEachLockMask(uint keyModXOnOrOff, Func func)
+{
+    const uint keyModMaskX = ~keyModXOnOrOff;
+    for (uint irrelevantBitsMask = 0; irrelevantBitsMask <= 0xff; irrelevantBitsMask++) {
+        if ((irrelevantBitsMask & keyModMaskX) == 0) {
+            func(irrelevantBitsMask);
         }
+    }
+}
+
+QSet<KGlobalAccelImpl::GrabTarget> KGlobalAccelImpl::sendGrabs(const QSet<GrabTarget> &targets)
+{
+    // A grab fails when another client holds it already, and that client
+    // usually keeps it. Every attempt costs a round trip and the ungrabs, and
+    // the registry tries again on every activation, context switch and remap,
+    // so after a failure the target is left alone for a while.
+    QSet<GrabTarget> attempted;
+    attempted.reserve(targets.size());
+    for (const GrabTarget &target : targets) {
+        auto it = m_contestedTargets.constFind(target);
+        if (it == m_contestedTargets.cend() || it->retry.hasExpired()) {
+            attempted.insert(target);
+        }
+    }
+    if (attempted.isEmpty()) {
+        return {};
+    }
 
-        // We'll have to grab 8 key modifier combinations in order to cover all
-        //  combinations of CapsLock, NumLock, ScrollLock.
-        // Does anyone with more X-savvy know how to set a mask on QX11Info::appRootWindow so that
-        //  the irrelevant bits are always ignored and we can just make one XGrabKey
-        //  call per accelerator? -- ellis
-#ifndef NDEBUG
-        QString sDebug = QStringLiteral("\tcode: 0x%1 state: 0x%2 | ").arg(keyCodeX, 0, 16).arg(keyModX, 0, 16);
+#if HAVE_XCB_XINPUT
+    const QSet<GrabTarget> grabbed = m_xiOpcode ? sendXInput2Grabs(attempted) : sendCoreGrabs(attempted);
+#else
+    const QSet<GrabTarget> grabbed = sendCoreGrabs(attempted);
 #endif
-        uint keyModMaskX = ~g_keyModMaskXOnOrOff;
+
+    for (const GrabTarget &target : std::as_const(attempted)) {
+        if (grabbed.contains(target)) {
+            m_contestedTargets.remove(target);
+            continue;
+        }
+        ContestedGrab &contested = m_contestedTargets[target];
+        contested.failures = std::min(contested.failures + 1, s_contestedMaxFailures);
+        contested.retry.setRemainingTime(s_contestedRetryInterval * (1 << (contested.failures - 1)));
+    }
+    scheduleContestedRetry();
+
+    return grabbed;
+}
+
+void KGlobalAccelImpl::scheduleContestedRetry()
+{
+    std::optional<std::chrono::milliseconds> next;
+    for (const ContestedGrab &contested : std::as_const(m_contestedTargets)) {
+        if (!contested.retry.hasExpired()) {
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(contested.retry.remainingTimeAsDuration());
+            next = next ? std::min(*next, remaining) : remaining;
+        }
+    }
+
+    if (next) {
+        m_contestedRetryTimer->start(*next);
+    } else {
+        m_contestedRetryTimer->stop();
+    }
+}
+
+QList<int> KGlobalAccelImpl::contestedKeys() const
+{
+    QList<int> keys;
+    for (auto it = m_resolvedKeys.cbegin(); it != m_resolvedKeys.cend(); ++it) {
+        if (m_grabbedKeys.contains(it.key())) {
+            continue;
+        }
+        const bool contested = std::any_of(it->cbegin(), it->cend(), [this](const GrabTarget &target) {
+            return m_contestedTargets.contains(target);
+        });
+        if (contested) {
+            keys.append(it.key());
+        }
+    }
+    return keys;
+}
+
+QSet<KGlobalAccelImpl::GrabTarget> KGlobalAccelImpl::sendCoreGrabs(const QSet<GrabTarget> &targets)
+{
+    xcb_connection_t *c = QX11Info::connection();
+
+    // Send the requests for all targets first, and only then wait for the errors.
+    // That way the whole batch costs a single round trip to the X server.
+    QList<std::pair<GrabTarget, QList<xcb_void_cookie_t>>> pendingGrabs;
+    pendingGrabs.reserve(targets.size());
+    for (const GrabTarget &target : targets) {
         QList<xcb_void_cookie_t> cookies;
-        for (uint irrelevantBitsMask = 0; irrelevantBitsMask <= 0xff; irrelevantBitsMask++) {
-            if ((irrelevantBitsMask & keyModMaskX) == 0) {
-#ifndef NDEBUG
-                sDebug += QStringLiteral("0x%3, ").arg(irrelevantBitsMask, 0, 16);
-#endif
-                if (grab) {
-                    cookies << xcb_grab_key_checked(QX11Info::connection(),
-                                                    true,
-                                                    QX11Info::appRootWindow(),
-                                                    keyModX | irrelevantBitsMask,
-                                                    keyCodeX,
-                                                    XCB_GRAB_MODE_ASYNC,
-                                                    XCB_GRAB_MODE_SYNC);
-                } else {
-                    /* clang-format off */
-                    cookies << xcb_ungrab_key_checked(QX11Info::connection(),
-                                                      keyCodeX, QX11Info::appRootWindow(),
-                                                      keyModX | irrelevantBitsMask);
-                    /* clang-format on */
-                }
+        forEachLockMask(g_keyModMaskXOnOrOff, [&](uint mask) {
+            cookies << xcb_grab_key_checked(c, true, QX11Info::appRootWindow(), target.modX | mask, target.keyCode, XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_SYNC);
+        });
+        pendingGrabs.append({target, cookies});
+    }
+
+    QSet<GrabTarget> grabbed;
+    for (const auto &[target, cookies] : std::as_const(pendingGrabs)) {
+        bool failed = false;
+        for (const xcb_void_cookie_t &cookie : cookies) {
+            QScopedPointer<xcb_generic_error_t, QScopedPointerPodDeleter> error(xcb_request_check(c, cookie));
+            if (!error.isNull()) {
+                failed = true;
             }
         }
 
-        bool failed = false;
-        if (grab) {
-            for (int i = 0; i < cookies.size(); ++i) {
-                QScopedPointer<xcb_generic_error_t, QScopedPointerPodDeleter> error(xcb_request_check(QX11Info::connection(), cookies.at(i)));
-                if (!error.isNull()) {
-                    failed = true;
-                }
+        if (failed) {
+            qCDebug(KGLOBALACCELD) << "grab failed for keycode" << int(target.keyCode) << "with modifiers 0x" << Qt::hex << target.modX;
+            forEachLockMask(g_keyModMaskXOnOrOff, [&](uint mask) {
+                xcb_ungrab_key(c, target.keyCode, QX11Info::appRootWindow(), target.modX | mask);
+            });
+        } else {
+            grabbed.insert(target);
+        }
+    }
+    xcb_flush(c);
+
+    return grabbed;
+}
+
+void KGlobalAccelImpl::sendUngrabs(const QSet<GrabTarget> &targets, uint keyModXOnOrOff)
+{
+#if HAVE_XCB_XINPUT
+    if (m_xiOpcode) {
+        sendXInput2Ungrabs(targets, keyModXOnOrOff);
+        return;
+    }
+#endif
+
+    xcb_connection_t *c = QX11Info::connection();
+    for (const GrabTarget &target : targets) {
+        forEachLockMask(keyModXOnOrOff, [&](uint mask) {
+            xcb_void_cookie_t cookie = xcb_ungrab_key_checked(c, target.keyCode, QX11Info::appRootWindow(), target.modX | mask);
+            xcb_discard_reply(c, cookie.sequence);
+        });
+    }
+    xcb_flush(c);
+}
+
+#if HAVE_XCB_XINPUT
+static QList<uint32_t> lockModifierSets(uint modX, uint keyModXOnOrOff)
+{
+    QList<uint32_t> modifiers;
+    forEachLockMask(keyModXOnOrOff, [&](uint mask) {
+        modifiers.append(modX | mask);
+    });
+    return modifiers;
+}
+
+QSet<KGlobalAccelImpl::GrabTarget> KGlobalAccelImpl::sendXInput2Grabs(const QSet<GrabTarget> &targets)
+{
+    xcb_connection_t *c = QX11Info::connection();
+
+    // An XInput2 passive grab takes all combinations of the lock modifiers at
+    // once, so every target is a single request instead of up to 16
+    const uint32_t eventMask = XCB_INPUT_XI_EVENT_MASK_KEY_PRESS;
+    QList<std::pair<GrabTarget, xcb_input_xi_passive_grab_device_cookie_t>> pendingGrabs;
+    pendingGrabs.reserve(targets.size());
+    for (const GrabTarget &target : targets) {
+        const QList<uint32_t> modifiers = lockModifierSets(target.modX, g_keyModMaskXOnOrOff);
+        pendingGrabs.append({target,
+                             xcb_input_xi_passive_grab_device(c,
+                                                              XCB_CURRENT_TIME,
+                                                              QX11Info::appRootWindow(),
+                                                              XCB_CURSOR_NONE,
+                                                              target.keyCode,
+                                                              XCB_INPUT_DEVICE_ALL_MASTER,
+                                                              modifiers.size(),
+                                                              1,
+                                                              XCB_INPUT_GRAB_TYPE_KEYCODE,
+                                                              XCB_INPUT_GRAB_MODE_22_SYNC,
+                                                              XCB_INPUT_GRAB_MODE_22_ASYNC,
+                                                              XCB_INPUT_GRAB_OWNER_OWNER,
+                                                              &eventMask,
+                                                              modifiers.constData())});
+    }
+
+    QSet<GrabTarget> grabbed;
+    QSet<GrabTarget> failed;
+    for (const auto &[target, cookie] : std::as_const(pendingGrabs)) {
+        // The reply lists the modifier sets which could not be grabbed
+        QScopedPointer<xcb_input_xi_passive_grab_device_reply_t, QScopedPointerPodDeleter> reply(
+            xcb_input_xi_passive_grab_device_reply(c, cookie, nullptr));
+        if (reply && reply->num_modifiers == 0) {
+            grabbed.insert(target);
+        } else {
+            qCDebug(KGLOBALACCELD) << "grab failed for keycode" << int(target.keyCode) << "with modifiers 0x" << Qt::hex << target.modX;
+            failed.insert(target);
+        }
+    }
+    sendXInput2Ungrabs(failed, g_keyModMaskXOnOrOff);
+
+    return grabbed;
+}
+
+void KGlobalAccelImpl::sendXInput2Ungrabs(const QSet<GrabTarget> &targets, uint keyModXOnOrOff)
+{
+    xcb_connection_t *c = QX11Info::connection();
+    for (const GrabTarget &target : targets) {
+        const QList<uint32_t> modifiers = lockModifierSets(target.modX, keyModXOnOrOff);
+        xcb_void_cookie_t cookie = xcb_input_xi_passive_ungrab_device_checked(c,
+                                                                              QX11Info::appRootWindow(),
+                                                                              target.keyCode,
+                                                                              XCB_INPUT_DEVICE_ALL_MASTER,
+                                                                              modifiers.size(),
+                                                                              XCB_INPUT_GRAB_TYPE_KEYCODE,
+                                                                              modifiers.constData());
+        xcb_discard_reply(c, cookie.sequence);
+    }
+    xcb_flush(c);
+}
+#endif
+
+QList<bool> KGlobalAccelImpl::grabKeysBatch(const QList<int> &keys, bool grab)
+{
+    QList<bool> results(keys.size(), false);
+
+    // grabKey is called during shutdown
+    // shutdown might be due to the X server being killed
+    // if so, fail immediately before trying to make other xcb calls
+    xcb_connection_t *c = QX11Info::connection();
+    if (!c || xcb_connection_has_error(c)) {
+        return results;
+    }
+
+    if (!grab) {
+        // Release what was grabbed for the keys, unless other keys still need it
+        QSet<GrabTarget> released;
+        for (qsizetype i = 0; i < keys.size(); ++i) {
+            auto it = m_grabbedKeys.find(keys[i]);
+            if (it == m_grabbedKeys.end()) {
+                continue;
             }
-            if (failed) {
-                qCDebug(KGLOBALACCELD) << "grab failed!\n";
-                for (uint m = 0; m <= 0xff; m++) {
-                    if ((m & keyModMaskX) == 0) {
-                        xcb_ungrab_key(QX11Info::connection(), keyCodeX, QX11Info::appRootWindow(), keyModX | m);
-                    }
+
+            for (const GrabTarget &target : std::as_const(*it)) {
+                if (--m_grabbedTargets[target] == 0) {
+                    m_grabbedTargets.remove(target);
+                    released.insert(target);
                 }
-            } else {
-                success = true;
             }
+            m_grabbedKeys.erase(it);
+            results[i] = true;
         }
+        sendUngrabs(released, g_keyModMaskXOnOrOff);
+        updateRecordedKeyCodes();
+        return results;
     }
-    free(keyCodes);
-    return success;
+
+    if (!m_keySymbols) {
+        m_keySymbols = xcb_key_symbols_alloc(c);
+        if (!m_keySymbols) {
+            return results;
+        }
+    }
+
+    QList<QList<GrabTarget>> resolved(keys.size());
+    QSet<GrabTarget> newTargets;
+    for (qsizetype i = 0; i < keys.size(); ++i) {
+        if (m_grabbedKeys.contains(keys[i])) {
+            results[i] = true;
+            continue;
+        }
+
+        if (!resolveGrabTargets(keys[i], &resolved[i])) {
+            continue;
+        }
+
+        for (const GrabTarget &target : std::as_const(resolved[i])) {
+            if (!m_grabbedTargets.contains(target)) {
+                newTargets.insert(target);
+            }
+        }
+    }
+
+    const QSet<GrabTarget> grabbed = sendGrabs(newTargets);
+
+    for (qsizetype i = 0; i < keys.size(); ++i) {
+        QList<GrabTarget> &targets = resolved[i];
+        targets.removeIf([this, &grabbed](const GrabTarget &target) {
+            return !grabbed.contains(target) && !m_grabbedTargets.contains(target);
+        });
+
+        // Grabbing any of the keycodes is enough
+        if (targets.isEmpty()) {
+            continue;
+        }
+
+        for (const GrabTarget &target : std::as_const(targets)) {
+            ++m_grabbedTargets[target];
+        }
+        m_grabbedKeys.insert(keys[i], targets);
+        results[i] = true;
+    }
+    updateRecordedKeyCodes();
+
+    return results;
 }
 
 bool KGlobalAccelImpl::nativeEventFilter(const QByteArray &eventType, void *message, qintptr *)
@@ -351,7 +867,41 @@ bool KGlobalAccelImpl::nativeEventFilter(const QByteArray &eventType, void *mess
 
     } else if (responseType == XCB_KEY_PRESS) {
         qCDebug(KGLOBALACCELD) << "Got XKeyPress event";
-        return x11KeyPress(reinterpret_cast<xcb_key_press_event_t *>(event));
+        auto keyPress = reinterpret_cast<xcb_key_press_event_t *>(event);
+        if (m_recordReader && !m_xiRawEvents) {
+            processRecordedEvents();
+            // Presses are reported in order, one still waiting goes first
+            finishPendingPress();
+        }
+
+        // The release of a grabbed key is only seen through XRecord. The grab
+        // freezes the keyboard until x11KeyPress() releases it on the same
+        // connection, which the X server processes after the recording was
+        // enabled here, so the release can't be missed.
+        m_shortcutHeld = true;
+        updateRecording();
+
+        // Autorepeat activates the grab again and again. Core events don't
+        // say whether they are repeated, but the key wasn't released since.
+        // Releases come through XRecord on another connection, which may be
+        // behind this one. It records the press as well, once it got that
+        // far every release before it is known. Until then the press waits in
+        // m_pendingPress, see processRecordedEvents().
+        if (m_recordReader && !m_xiRawEvents) {
+            if (keyPress->detail == m_pressedKeyCode && !m_recordReader->isTimeRecorded(keyPress->time)) {
+                ungrabActivatedKey(0);
+                m_pendingPress = *keyPress;
+                m_pendingPressTimer->start();
+                return true;
+            }
+        }
+        const bool repeat = keyPress->detail == m_pressedKeyCode;
+        m_pressedKeyCode = keyPress->detail;
+        return x11KeyPress(keyPress, 0, repeat ? ShortcutKeyState::Repeated : ShortcutKeyState::Pressed);
+#if HAVE_XCB_XINPUT
+    } else if (responseType == XCB_GE_GENERIC && m_xiOpcode && reinterpret_cast<xcb_ge_generic_event_t *>(event)->extension == m_xiOpcode) {
+        return handleXInput2Event(reinterpret_cast<xcb_ge_generic_event_t *>(event));
+#endif
     } else if (m_xkb_first_event && responseType == m_xkb_first_event) {
         const uint8_t xkbEvent = event->pad0;
         switch (xkbEvent) {
@@ -390,18 +940,64 @@ void KGlobalAccelImpl::scheduleX11MappingNotify()
     }
 }
 
+QByteArray KGlobalAccelImpl::keymapFingerprint() const
+{
+    xcb_connection_t *c = QX11Info::connection();
+    const xcb_setup_t *setup = xcb_get_setup(c);
+    const xcb_get_keyboard_mapping_cookie_t keyboardCookie =
+        xcb_get_keyboard_mapping(c, setup->min_keycode, setup->max_keycode - setup->min_keycode + 1);
+    const xcb_get_modifier_mapping_cookie_t modifierCookie = xcb_get_modifier_mapping(c);
+
+    QScopedPointer<xcb_get_keyboard_mapping_reply_t, QScopedPointerPodDeleter> keyboardMapping(xcb_get_keyboard_mapping_reply(c, keyboardCookie, nullptr));
+    QScopedPointer<xcb_get_modifier_mapping_reply_t, QScopedPointerPodDeleter> modifierMapping(xcb_get_modifier_mapping_reply(c, modifierCookie, nullptr));
+    if (!keyboardMapping || !modifierMapping) {
+        return {};
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(xcb_get_keyboard_mapping_keysyms(keyboardMapping.data())),
+                                xcb_get_keyboard_mapping_keysyms_length(keyboardMapping.data()) * sizeof(xcb_keysym_t)));
+    hash.addData(QByteArrayView(reinterpret_cast<const char *>(xcb_get_modifier_mapping_keycodes(modifierMapping.data())),
+                                xcb_get_modifier_mapping_keycodes_length(modifierMapping.data()) * sizeof(xcb_keycode_t)));
+    return hash.result();
+}
+
 void KGlobalAccelImpl::x11MappingNotify()
 {
     qCDebug(KGLOBALACCELD) << "Re-mapping keys";
-    // Maybe the X modifier map has been changed.
-    // uint oldKeyModMaskXAccel = g_keyModMaskXAccel;
-    // uint oldKeyModMaskXOnOrOff = g_keyModMaskXOnOrOff;
 
-    // First ungrab all currently grabbed keys. This is needed because we
-    // store the keys as qt keycodes and use KKeyServer to map them to x11 key
-    // codes. After calling KKeyServer::initializeMods() they could map to
-    // different keycodes.
-    ungrabKeys();
+    xcb_connection_t *c = QX11Info::connection();
+    if (!c || xcb_connection_has_error(c)) {
+        return;
+    }
+
+    // Switching between layouts often replaces the whole keymap, and most
+    // notifications come in bursts for a single change. Nothing has to be
+    // done for a keymap we have already, and the tables of the previous ones
+    // are kept, so that switching back doesn't resolve everything again.
+    const QByteArray fingerprint = keymapFingerprint();
+    if (!fingerprint.isEmpty() && fingerprint == m_keymapFingerprint) {
+        qCDebug(KGLOBALACCELD) << "Keymap unchanged";
+        return;
+    }
+    if (!m_keymapFingerprint.isEmpty()) {
+        m_keymapCache.append({m_keymapFingerprint, {std::move(m_resolvedKeys), std::move(m_decodedKeys)}});
+        if (m_keymapCache.size() > s_keymapCacheSize) {
+            m_keymapCache.removeFirst();
+        }
+    }
+    m_resolvedKeys.clear();
+    m_decodedKeys.clear();
+    m_keymapFingerprint = fingerprint;
+    auto cached = std::find_if(m_keymapCache.begin(), m_keymapCache.end(), [&fingerprint](const auto &entry) {
+        return entry.first == fingerprint;
+    });
+    if (!fingerprint.isEmpty() && cached != m_keymapCache.end()) {
+        qCDebug(KGLOBALACCELD) << "Switching back to a known keymap";
+        m_resolvedKeys = std::move(cached->second.resolvedKeys);
+        m_decodedKeys = std::move(cached->second.decodedKeys);
+        m_keymapCache.erase(cached);
+    }
 
     if (m_keySymbols) {
         // Force reloading of the keySym mapping
@@ -409,30 +1005,115 @@ void KGlobalAccelImpl::x11MappingNotify()
         m_keySymbols = nullptr;
     }
 
+    // Maybe the X modifier map has been changed.
+    const uint oldKeyModMaskXOnOrOff = g_keyModMaskXOnOrOff;
     KKeyServer::initializeMods();
     calculateGrabMasks();
 
-    grabKeys();
+    m_keySymbols = xcb_key_symbols_alloc(c);
+    if (!m_keySymbols) {
+        return;
+    }
+
+    // We store the keys as qt keycodes and use KKeyServer to map them to x11 key
+    // codes. After calling KKeyServer::initializeMods() they could map to
+    // different keycodes. Resolve them again and only release and grab the
+    // keycode/modifier combinations which changed, most mapping changes only
+    // touch a few keys, if any grabbed one at all.
+    QHash<int, QList<GrabTarget>> newKeys;
+    QHash<GrabTarget, int> newTargets;
+    for (auto it = m_grabbedKeys.cbegin(); it != m_grabbedKeys.cend(); ++it) {
+        QList<GrabTarget> targets;
+        resolveGrabTargets(it.key(), &targets);
+        for (const GrabTarget &target : std::as_const(targets)) {
+            ++newTargets[target];
+        }
+        newKeys.insert(it.key(), targets);
+    }
+
+    // The grabs cover all combinations of the lock modifiers, if those changed everything has to be grabbed again
+    const bool lockModifiersChanged = g_keyModMaskXOnOrOff != oldKeyModMaskXOnOrOff;
+    QSet<GrabTarget> released;
+    for (auto it = m_grabbedTargets.cbegin(); it != m_grabbedTargets.cend(); ++it) {
+        if (lockModifiersChanged || !newTargets.contains(it.key())) {
+            released.insert(it.key());
+        }
+    }
+    QSet<GrabTarget> added;
+    for (auto it = newTargets.cbegin(); it != newTargets.cend(); ++it) {
+        if (lockModifiersChanged || !m_grabbedTargets.contains(it.key())) {
+            added.insert(it.key());
+        }
+    }
+
+    sendUngrabs(released, oldKeyModMaskXOnOrOff);
+    const QSet<GrabTarget> grabbed = sendGrabs(added);
+    qCDebug(KGLOBALACCELD) << "Released" << released.size() << "and grabbed" << grabbed.size() << "of" << added.size() << "keycode/modifier combinations";
+
+    // Keys left without any grab are not grabbed anymore, their shortcuts go
+    // back to the keys which failed or are contested
+    QList<int> lostKeys;
+    m_grabbedTargets.clear();
+    for (auto it = newKeys.begin(); it != newKeys.end();) {
+        it->removeIf([&added, &grabbed](const GrabTarget &target) {
+            return added.contains(target) && !grabbed.contains(target);
+        });
+        if (it->isEmpty()) {
+            lostKeys.append(it.key());
+            it = newKeys.erase(it);
+            continue;
+        }
+        for (const GrabTarget &target : std::as_const(*it)) {
+            ++m_grabbedTargets[target];
+        }
+        ++it;
+    }
+    m_grabbedKeys = std::move(newKeys);
+    updateRecordedKeyCodes();
+
+    if (!lostKeys.isEmpty()) {
+        keysLost(lostKeys);
+    }
+
+    // Keys which could not be grabbed so far may be available in the new mapping
+    grabFailedKeys();
 }
 
-bool KGlobalAccelImpl::x11KeyPress(xcb_key_press_event_t *pEvent)
+bool KGlobalAccelImpl::x11KeyPress(xcb_key_press_event_t *pEvent, uint16_t xiDevice, ShortcutKeyState state)
 {
     if (QWidget::keyboardGrabber() || QApplication::activePopupWidget()) {
         qCWarning(KGLOBALACCELD) << "kglobalacceld should be popup and keyboard grabbing free!";
     }
 
+    ungrabActivatedKey(xiDevice);
+    return reportKeyPress(pEvent, state);
+}
+
+void KGlobalAccelImpl::ungrabActivatedKey(uint16_t xiDevice)
+{
     // Keyboard needs to be ungrabed after XGrabKey() activates the grab,
     // otherwise it becomes frozen.
     xcb_connection_t *c = QX11Info::connection();
-    xcb_void_cookie_t cookie = xcb_ungrab_keyboard_checked(c, XCB_TIME_CURRENT_TIME);
+    xcb_void_cookie_t cookie;
+#if HAVE_XCB_XINPUT
+    if (xiDevice) {
+        cookie = xcb_input_xi_ungrab_device_checked(c, XCB_TIME_CURRENT_TIME, xiDevice);
+    } else
+#endif
+    {
+        cookie = xcb_ungrab_keyboard_checked(c, XCB_TIME_CURRENT_TIME);
+    }
     xcb_flush(c);
     // xcb_flush() only makes sure that the ungrab keyboard request has been
     // sent, but is not enough to make sure that request has been fulfilled. Use
     // xcb_request_check() to make sure that the request has been processed.
-    xcb_request_check(c, cookie);
+    free(xcb_request_check(c, cookie));
+}
 
+bool KGlobalAccelImpl::reportKeyPress(xcb_key_press_event_t *pEvent, ShortcutKeyState state)
+{
     int keyQt;
-    if (!KKeyServer::xcbKeyPressEventToQt(pEvent, &keyQt)) {
+    if (!keyPressEventToQt(pEvent, &keyQt)) {
         qCWarning(KGLOBALACCELD) << "KKeyServer::xcbKeyPressEventToQt failed";
         return false;
     }
@@ -442,7 +1123,7 @@ bool KGlobalAccelImpl::x11KeyPress(xcb_key_press_event_t *pEvent)
     if (NET::timestampCompare(pEvent->time, QX11Info::appTime()) > 0) {
         QX11Info::setAppTime(pEvent->time);
     }
-    return keyEvent(keyQt, ShortcutKeyState::Pressed);
+    return keyEvent(keyQt, state);
 }
 
 bool KGlobalAccelImpl::x11KeyRelease(xcb_key_release_event_t *pEvent)
@@ -452,7 +1133,7 @@ bool KGlobalAccelImpl::x11KeyRelease(xcb_key_release_event_t *pEvent)
     }
 
     int keyQt;
-    if (!KKeyServer::xcbKeyPressEventToQt(pEvent, &keyQt)) {
+    if (!keyPressEventToQt(pEvent, &keyQt)) {
         return false;
     }
     return keyEvent(keyQt, ShortcutKeyState::Released);
@@ -9,13 +9,22 @@
 #define _KGLOBALACCEL_X11_H
 
 #include "../../kglobalaccel_interface.h"
+#include "xrecordreader.h"
 
 #include <QAbstractNativeEventFilter>
+#include <QDeadlineTimer>
+#include <QHash>
 #include <QObject>
+#include <QSet>
+
+#include <chrono>
+#include <memory>
+#include <optional>
 
 struct xcb_key_press_event_t;
 typedef xcb_key_press_event_t xcb_key_release_event_t;
 struct xcb_button_press_event_t;
+struct xcb_ge_generic_event_t;
 typedef struct _XCBKeySymbols xcb_key_symbols_t;
 class QTimer;
 
@@ -49,10 +58,44 @@ public:
      * \return true if successful, otherwise false.
      */
     bool grabKey(int key, bool grab) override;
+    QList<bool> grabKeysBatch(const QList<int> &keys, bool grab) override;
+    //! Input is only recorded while there are modifier-only shortcuts
+    void setModifierOnlyShortcutsActive(bool active) override;
+    QList<int> contestedKeys() const override;
 
     bool nativeEventFilter(const QByteArray &eventType, void *message, qintptr *) override;
 
 private:
+    //! A keycode and the modifiers to grab it with
+    struct GrabTarget {
+        uint8_t keyCode;
+        uint modX;
+
+        bool operator==(const GrabTarget &other) const = default;
+        friend size_t qHash(const GrabTarget &target, size_t seed = 0)
+        {
+            return qHashMulti(seed, target.keyCode, target.modX);
+        }
+    };
+    //! Resolves @p keyQt to the keycodes it can be typed with in the current keymap, cached
+    bool resolveGrabTargets(int keyQt, QList<GrabTarget> *targets);
+    bool lookupGrabTargets(int keyQt, QList<GrabTarget> *targets);
+    /**
+     * Grabs @p targets with all combinations of the lock modifiers, returns the ones which succeeded.
+     * Targets which failed recently are not tried again until their backoff ran out.
+     */
+    QSet<GrabTarget> sendGrabs(const QSet<GrabTarget> &targets);
+    QSet<GrabTarget> sendCoreGrabs(const QSet<GrabTarget> &targets);
+    void sendUngrabs(const QSet<GrabTarget> &targets, uint keyModXOnOrOff);
+    //! The same with XInput2 passive grabs, one request per target, used whenever XInput2 is available
+    QSet<GrabTarget> sendXInput2Grabs(const QSet<GrabTarget> &targets);
+    void sendXInput2Ungrabs(const QSet<GrabTarget> &targets, uint keyModXOnOrOff);
+
+    //! Calls grabFailedKeys() once the first backoff of m_contestedTargets runs out
+    void scheduleContestedRetry();
+
+    //! Identifies the keymap, mapping notifications don't tell whether anything changed
+    QByteArray keymapFingerprint() const;
     void scheduleX11MappingNotify();
     void x11MappingNotify();
     /**
@@ -61,17 +104,91 @@ private:
      * returns true. Return false if the event is not processed.
      *
      * This is public for compatibility only. You do not need to call it.
+     *
+     * @p xiDevice is the device of the XInput2 grab which activated, 0 for a core grab.
+     * @p state is ShortcutKeyState::Repeated for autorepeat.
      */
-    bool x11KeyPress(xcb_key_press_event_t *event);
+    bool x11KeyPress(xcb_key_press_event_t *event, uint16_t xiDevice = 0, ShortcutKeyState state = ShortcutKeyState::Pressed);
+    //! Releases the grab which activated, the keyboard is frozen until then
+    void ungrabActivatedKey(uint16_t xiDevice);
+    //! x11KeyPress() without releasing the grab
+    bool reportKeyPress(xcb_key_press_event_t *event, ShortcutKeyState state);
+    //! Reports m_pendingPress as a press or a repeat, with the releases XRecord saw until now
+    void finishPendingPress();
     bool x11KeyRelease(xcb_key_release_event_t *event);
     bool x11ButtonPress(xcb_button_press_event_t *event);
 
+    //! KKeyServer::xcbKeyPressEventToQt(), with the results cached for the current keymap
+    bool keyPressEventToQt(xcb_key_press_event_t *event, int *keyQt);
+    //! Tells the record reader which keycodes matter, after the keymap or the grabs changed
+    void updateRecordedKeyCodes();
+    //! Records the input while there are modifier-only shortcuts or a grabbed key is held
+    void updateRecording();
+    void processRecordedEvents();
+    //! Feeds an event from XRecord or XInput2 into the modifier-only state machine
+    void handleRecordedEvent(const XRecordReader::Event &recorded);
+
+    //! Checks for XInput2, used for the grabs and, with KGLOBALACCELD_X11_INPUT=xinput2, for the modifier-only shortcuts
+    void initXInput2();
+    void selectXInput2RawEvents(bool select);
+    bool handleXInput2Event(xcb_ge_generic_event_t *event);
+    //! Whether another client, e.g. a screen locker, has grabbed the keyboard
+    bool isKeyboardGrabbedByOthers() const;
+
     xcb_key_symbols_t *m_keySymbols;
     uint8_t m_xkb_first_event;
-    void *m_display;
-    unsigned int m_xrecordCookieSequence;
+    void *m_display = nullptr;
+    std::unique_ptr<XRecordReader> m_recordReader;
+    //! Major opcode of XInput2 if it is available
+    uint8_t m_xiOpcode = 0;
+    //! XInput2 raw events are used instead of XRecord
+    bool m_xiRawEvents = false;
+    bool m_xiSelected = false;
+    //! The modifier keys currently held according to the raw events, keycode -> X modifier
+    QHash<uint8_t, uint16_t> m_xiModifiers;
+    //! The last raw event was the press of a modifier key
+    bool m_xiModifierPressed = false;
+    bool m_modifierOnlyShortcutsActive = false;
+    bool m_shortcutHeld = false;
+    //! The keycode of the last grab which activated, until it is released, to detect autorepeat
+    uint8_t m_pressedKeyCode = 0;
+    //! A press of the held key, until XRecord got far enough to tell whether it was released in between
+    std::optional<xcb_key_press_event_t> m_pendingPress;
+    //! How long a press waits for XRecord to see its key's release, it is usually there already
+    QTimer *m_pendingPressTimer;
+    static constexpr std::chrono::milliseconds s_recordedTimeout{20};
     QTimer *m_remapTimer;
-    bool m_keyboardGrabbed = false;
+
+    //! What is grabbed for each Qt key, to release exactly that and to find out what changed after a mapping change
+    QHash<int, QList<GrabTarget>> m_grabbedKeys;
+    //! How many Qt keys use each grabbed target, different keys can end up on the same keycode
+    QHash<GrabTarget, int> m_grabbedTargets;
+    //! A target which another client had grabbed when we tried
+    struct ContestedGrab {
+        int failures = 0;
+        //! It is not tried again before, the interval doubles with every failure
+        QDeadlineTimer retry;
+    };
+    QHash<GrabTarget, ContestedGrab> m_contestedTargets;
+    QTimer *m_contestedRetryTimer;
+    static constexpr std::chrono::seconds s_contestedRetryInterval{2};
+    //! Caps the backoff at about half an hour
+    static constexpr int s_contestedMaxFailures = 11;
+
+    //! Results of resolveGrabTargets() for the current keymap, empty for keys which cannot be grabbed
+    QHash<int, QList<GrabTarget>> m_resolvedKeys;
+    //! Results of keyPressEventToQt() by keycode and state, 0 if the event cannot be decoded
+    QHash<quint32, int> m_decodedKeys;
+
+    //! The tables above for a keymap which is not the current one
+    struct KeymapTables {
+        QHash<int, QList<GrabTarget>> resolvedKeys;
+        QHash<quint32, int> decodedKeys;
+    };
+    QByteArray m_keymapFingerprint;
+    //! Tables of the keymaps used before, the least recently used first
+    QList<std::pair<QByteArray, KeymapTables>> m_keymapCache;
+    static constexpr qsizetype s_keymapCacheSize = 4;
 };
 
 #endif // _KGLOBALACCEL_X11_H
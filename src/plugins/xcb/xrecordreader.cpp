@@ -0,0 +1,374 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "xrecordreader.h"
+
+#include "logging.h"
+
+#include <QScopedPointer>
+#include <private/qtx11extras_p.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+// It uses "explicit" as a variable name, which is not allowed in C++
+#define explicit xcb_explicit
+#include <xcb/record.h>
+#include <xcb/xcb.h>
+#undef explicit
+
+//! The keyboard grabs, and the input as well if @p withInput is true
+static xcb_record_range_t recordedRange(bool withInput)
+{
+    xcb_record_range_t range;
+    memset(&range, 0, sizeof(range));
+    if (withInput) {
+        range.device_events.first = XCB_KEY_PRESS;
+        range.device_events.last = XCB_BUTTON_PRESS;
+    }
+    range.core_requests.first = XCB_GRAB_KEYBOARD;
+    range.core_requests.last = XCB_UNGRAB_KEYBOARD;
+    return range;
+}
+
+XRecordReader::XRecordReader(const char *displayName, QObject *parent)
+    : QThread(parent)
+{
+    setObjectName(QStringLiteral("XRecordReader"));
+
+    // We use XRecord to get events XCB_KEY_PRESS, XCB_KEY_RELEASE, XCB_BUTTON_PRESS
+    // This is needed to correctly handle modifier-only shortcuts, so that they don't trigger
+    // on Mod+Click, or Mod+Key; release Key; release Mod
+    m_connection = xcb_connect(displayName, nullptr);
+    if (xcb_connection_has_error(m_connection)) {
+        qCWarning(KGLOBALACCELD) << "Failed to connect to the X server for recording input, modifier-only shortcuts won't work";
+        return;
+    }
+
+    // The context stays enabled, only the input is left out while it is
+    // disabled, see setEnabled(). The keyboard grabs of other clients are
+    // always recorded, nobody would tell us about a grab made in between.
+    m_context = xcb_generate_id(m_connection);
+    const xcb_record_range_t range = recordedRange(false);
+    xcb_record_client_spec_t cs = XCB_RECORD_CS_ALL_CLIENTS;
+    xcb_record_create_context(m_connection, m_context, 0, 1, 1, &cs, &range);
+    m_cookieSequence = xcb_record_enable_context(m_connection, m_context).sequence;
+    xcb_flush(m_connection);
+
+    if (pipe2(m_commandPipe, O_CLOEXEC) != 0) {
+        qCWarning(KGLOBALACCELD) << "Failed to create a pipe for the XRecord thread:" << strerror(errno);
+        m_commandPipe[0] = m_commandPipe[1] = -1;
+    }
+}
+
+XRecordReader::~XRecordReader()
+{
+    if (isRunning()) {
+        sendCommand(Stop);
+        wait();
+    }
+
+    for (int fd : m_commandPipe) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    xcb_disconnect(m_connection);
+}
+
+bool XRecordReader::isValid() const
+{
+    return !xcb_connection_has_error(m_connection) && m_commandPipe[0] >= 0;
+}
+
+void XRecordReader::setEnabled(bool enabled)
+{
+    if (m_enabled == enabled || !isValid()) {
+        return;
+    }
+    m_enabled = enabled;
+    qCDebug(KGLOBALACCELD) << (enabled ? "Enabling" : "Disabling") << "the recording of input";
+
+    // Registering the clients again replaces what is recorded of all of
+    // them. It is sent on the main connection, so that the X server applies
+    // it before anything the caller sends afterwards, e.g. the release of a
+    // grab whose key must be seen being released.
+    if (enabled) {
+        sendCommand(Enable);
+    }
+    xcb_connection_t *c = QX11Info::connection();
+    const xcb_record_range_t range = recordedRange(enabled);
+    xcb_record_client_spec_t cs = XCB_RECORD_CS_ALL_CLIENTS;
+    xcb_record_register_clients(c, m_context, 0, 1, 1, &cs, &range);
+    xcb_flush(c);
+}
+
+void XRecordReader::sendCommand(Command command)
+{
+    while (write(m_commandPipe[1], &command, 1) < 0 && errno == EINTR) { }
+}
+
+bool XRecordReader::handleCommands()
+{
+    char commands[16];
+    const ssize_t count = read(m_commandPipe[0], commands, sizeof(commands));
+    for (ssize_t i = 0; i < count; ++i) {
+        switch (commands[i]) {
+        case Stop:
+            return false;
+        case Enable:
+            // No input was recorded while it was disabled, the main thread may have seen a Reset
+            // of its own since. The keyboard grabs were recorded all the time.
+            m_lastWasReset = false;
+            break;
+        }
+    }
+    return true;
+}
+
+void XRecordReader::storeKeyCodes(AtomicKeyCodes &target, const KeyCodes &keyCodes)
+{
+    for (size_t i = 0; i < target.size(); ++i) {
+        uint64_t word = 0;
+        for (size_t bit = 0; bit < 64; ++bit) {
+            if (keyCodes.test(i * 64 + bit)) {
+                word |= uint64_t(1) << bit;
+            }
+        }
+        target[i].store(word, std::memory_order_relaxed);
+    }
+}
+
+bool XRecordReader::containsKeyCode(const AtomicKeyCodes &keyCodes, uint8_t keyCode)
+{
+    return keyCodes[keyCode / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (keyCode % 64));
+}
+
+void XRecordReader::setModifierKeyCodes(const KeyCodes &keyCodes)
+{
+    storeKeyCodes(m_modifierKeyCodes, keyCodes);
+}
+
+void XRecordReader::setReleaseKeyCodes(const KeyCodes &keyCodes)
+{
+    storeKeyCodes(m_releaseKeyCodes, keyCodes);
+}
+
+void XRecordReader::run()
+{
+    pollfd fds[2];
+    fds[0].fd = xcb_get_file_descriptor(m_connection);
+    fds[0].events = POLLIN;
+    fds[1].fd = m_commandPipe[0];
+    fds[1].events = POLLIN;
+
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCWarning(KGLOBALACCELD) << "Polling the XRecord connection failed:" << strerror(errno);
+            return;
+        }
+
+        if (fds[1].revents && !handleCommands()) {
+            return;
+        }
+
+        readReplies();
+
+        if (xcb_connection_has_error(m_connection)) {
+            qCWarning(KGLOBALACCELD) << "Lost the XRecord connection, modifier-only shortcuts won't work anymore";
+            return;
+        }
+    }
+}
+
+void XRecordReader::readReplies()
+{
+    xcb_generic_event_t *event;
+    while ((event = xcb_poll_for_event(m_connection))) {
+        std::free(event);
+    }
+
+    const uint32_t tail = m_ringTail.load(std::memory_order_relaxed);
+    const uint32_t lastTime = m_lastTime;
+
+    xcb_record_enable_context_reply_t *reply = nullptr;
+    xcb_generic_error_t *error = nullptr;
+    while (m_cookieSequence && xcb_poll_for_reply(m_connection, m_cookieSequence, (void **)&reply, &error)) {
+        // xcb_poll_for_reply may set both reply and error to null if connection has error.
+        // break if xcb_connection has error, no point to continue anyway.
+        if (xcb_connection_has_error(m_connection)) {
+            break;
+        }
+
+        if (error) {
+            std::free(error);
+            break;
+        }
+
+        if (!reply) {
+            continue;
+        }
+
+        QScopedPointer<xcb_record_enable_context_reply_t, QScopedPointerPodDeleter> data(reply);
+        const uint8_t *recorded = xcb_record_enable_context_data(reply);
+        handleRecordedData(recorded, recorded + xcb_record_enable_context_data_length(reply));
+    }
+
+    // One wakeup for everything read this time, and none while the main thread didn't get to the previous one yet
+    if (m_ringTail.load(std::memory_order_relaxed) != tail || m_ringOverflowed.load()) {
+        if (!m_wakeupPending.exchange(true)) {
+            Q_EMIT eventsAvailable();
+        }
+    }
+
+    // After the events are in the ring, see isTimeRecorded()
+    if (m_lastTime != lastTime) {
+        QMutexLocker locker(&m_timeMutex);
+        m_recordedTime = m_lastTime;
+        // The X server time wraps around after 49 days
+        if (m_awaitedTime && int32_t(m_lastTime - *m_awaitedTime) >= 0) {
+            m_awaitedTime.reset();
+            locker.unlock();
+            Q_EMIT timeRecorded();
+        }
+    }
+}
+
+void XRecordReader::handleRecordedData(const uint8_t *data, const uint8_t *dataEnd)
+{
+    while (data < dataEnd) {
+        switch (*data) {
+        case XCB_KEY_PRESS: {
+            // only handle modifier keys here, so as not to trigger when
+            // event is grabbed by other clients; handle normal keys in
+            // nativeEventFilter
+            auto keyPressEvent = reinterpret_cast<const xcb_key_press_event_t *>(data);
+            data += sizeof(xcb_key_press_event_t);
+            m_lastTime = keyPressEvent->time;
+            if (m_keyboardGrabbed.load()) {
+                break;
+            }
+            if (containsKeyCode(m_modifierKeyCodes, keyPressEvent->detail)) {
+                pushEvent(Event::KeyPress, keyPressEvent->detail, keyPressEvent->state);
+            } else {
+                // even though we don't handle the key, we need to update the state machine
+                pushEvent(Event::Reset);
+            }
+        } break;
+        case XCB_KEY_RELEASE: {
+            auto keyReleaseEvent = reinterpret_cast<const xcb_key_release_event_t *>(data);
+            data += sizeof(xcb_key_release_event_t);
+            m_lastTime = keyReleaseEvent->time;
+            if (m_keyboardGrabbed.load()) {
+                break;
+            }
+            // Autorepeat sends a release and a press with the same time, the key is still held
+            if (data + sizeof(xcb_key_press_event_t) <= dataEnd && *data == XCB_KEY_PRESS) {
+                auto next = reinterpret_cast<const xcb_key_press_event_t *>(data);
+                if (next->detail == keyReleaseEvent->detail && next->time == keyReleaseEvent->time) {
+                    break;
+                }
+            }
+            if (containsKeyCode(m_modifierKeyCodes, keyReleaseEvent->detail) || containsKeyCode(m_releaseKeyCodes, keyReleaseEvent->detail)) {
+                pushEvent(Event::KeyRelease, keyReleaseEvent->detail, keyReleaseEvent->state);
+            } else {
+                pushEvent(Event::Reset);
+            }
+        } break;
+        case XCB_BUTTON_PRESS:
+            m_lastTime = reinterpret_cast<const xcb_button_press_event_t *>(data)->time;
+            pushEvent(Event::Reset);
+            data += sizeof(xcb_button_press_event_t);
+            break;
+        case XCB_UNGRAB_KEYBOARD:
+            m_keyboardGrabbed.store(false);
+            data += sizeof(xcb_ungrab_keyboard_request_t);
+            break;
+        case XCB_GRAB_KEYBOARD:
+            m_keyboardGrabbed.store(true);
+            data += sizeof(xcb_grab_keyboard_request_t);
+            break;
+        default:
+            // Impossible
+            qCWarning(KGLOBALACCELD) << "Got unknown event type" << *data;
+            data = dataEnd; // exit the while loop
+            break;
+        }
+    }
+}
+
+void XRecordReader::pushEvent(Event::Type type, uint8_t keyCode, uint16_t state)
+{
+    // A run of other input only has to leave the modifier-only state once
+    if (type == Event::Reset) {
+        if (m_lastWasReset) {
+            return;
+        }
+        m_lastWasReset = true;
+    } else {
+        m_lastWasReset = false;
+    }
+
+    const uint32_t tail = m_ringTail.load(std::memory_order_relaxed);
+    if (tail - m_ringHead.load(std::memory_order_acquire) == s_ringSize) {
+        // The main thread is stuck, it resets the state once it catches up
+        m_ringOverflowed.store(true);
+        return;
+    }
+
+    m_ring[tail % s_ringSize] = {type, keyCode, state, m_lastTime};
+    m_ringTail.store(tail + 1, std::memory_order_release);
+}
+
+bool XRecordReader::takeEvent(Event *event)
+{
+    auto takeFromRing = [this, event] {
+        const uint32_t head = m_ringHead.load(std::memory_order_relaxed);
+        if (head == m_ringTail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *event = m_ring[head % s_ringSize];
+        m_ringHead.store(head + 1, std::memory_order_release);
+        return true;
+    };
+
+    if (takeFromRing()) {
+        return true;
+    }
+
+    if (m_ringOverflowed.exchange(false)) {
+        *event = {Event::Reset, 0, 0, 0};
+        return true;
+    }
+
+    // Check again after allowing new wakeups, events pushed in between would be missed otherwise
+    m_wakeupPending.store(false);
+    return takeFromRing();
+}
+
+bool XRecordReader::isTimeRecorded(uint32_t time)
+{
+    QMutexLocker locker(&m_timeMutex);
+    // The X server time wraps around after 49 days
+    if (m_recordedTime && int32_t(*m_recordedTime - time) >= 0) {
+        return true;
+    }
+    m_awaitedTime = time;
+    return false;
+}
+
+bool XRecordReader::isKeyboardGrabbed() const
+{
+    return m_keyboardGrabbed.load();
+}
+
+#include "moc_xrecordreader.cpp"
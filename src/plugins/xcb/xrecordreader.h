@@ -0,0 +1,166 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef XRECORDREADER_H
+#define XRECORDREADER_H
+
+#include <QMutex>
+#include <QThread>
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <optional>
+
+struct xcb_connection_t;
+
+/**
+ * @internal
+ *
+ * Reads the key and pointer events of all clients from an XRecord context on
+ * its own thread, so that typing in other applications doesn't keep the main
+ * thread busy.
+ *
+ * Only what matters for modifier-only shortcuts is handed to the main thread:
+ * presses and releases of modifier keys, releases of grabbed keys and a single
+ * Reset for any run of other key presses, key releases and pointer presses.
+ * The releases autorepeat sends in between presses are dropped.
+ * The events are passed through a fixed size single producer, single consumer
+ * ring, eventsAvailable() is emitted once for every batch of them.
+ */
+class XRecordReader : public QThread
+{
+    Q_OBJECT
+
+public:
+    struct Event {
+        enum Type : uint8_t {
+            KeyPress,
+            KeyRelease,
+            //! Any other input, leaves the modifier-only state
+            Reset,
+        };
+        Type type;
+        uint8_t keyCode;
+        uint16_t state;
+        //! The X server time of the input, of the first one for a Reset
+        uint32_t time;
+    };
+    using KeyCodes = std::bitset<256>;
+
+    /**
+     * Connects to @p displayName and creates the record context, call start()
+     * to start reading from it.
+     */
+    explicit XRecordReader(const char *displayName, QObject *parent = nullptr);
+    ~XRecordReader() override;
+
+    bool isValid() const;
+
+    /**
+     * Enables or disables the recording of input. It starts disabled. While
+     * it is disabled the X server only sends us the keyboard grabs of other
+     * clients, so input in them costs nothing as long as nobody needs to see
+     * it. The change applies to what the X server processes after the
+     * requests the caller sends next on the main connection.
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * The keycodes whose presses and releases are passed on. May be called
+     * while the thread is running, the new set applies to the events read
+     * afterwards.
+     */
+    void setModifierKeyCodes(const KeyCodes &keyCodes);
+    //! The keycodes whose releases are passed on in addition to the modifier ones
+    void setReleaseKeyCodes(const KeyCodes &keyCodes);
+
+    /**
+     * Takes the next event from the ring, to be called from the thread the
+     * reader was created on. Returns false once the ring is empty, after that
+     * eventsAvailable() is emitted again for new events.
+     */
+    bool takeEvent(Event *event);
+
+    /**
+     * Whether the input up to the X server time @p time was recorded, so
+     * that takeEvent() returns everything which happened until then. If not,
+     * timeRecorded() is emitted once it was.
+     *
+     * Only useful while it is enabled, nothing is recorded otherwise.
+     */
+    bool isTimeRecorded(uint32_t time);
+
+    /**
+     * Whether another client grabbed the keyboard, e.g. a screen locker,
+     * according to the GrabKeyboard and UngrabKeyboard requests read so far.
+     * Those are recorded while it is disabled as well.
+     */
+    bool isKeyboardGrabbed() const;
+
+Q_SIGNALS:
+    void eventsAvailable();
+    //! The time last passed to isTimeRecorded() was reached
+    void timeRecorded();
+
+protected:
+    void run() override;
+
+private:
+    //! Sent to the thread through m_commandPipe
+    enum Command : char {
+        Stop,
+        Enable,
+    };
+    void sendCommand(Command command);
+    //! Returns false once the thread should stop
+    bool handleCommands();
+    void readReplies();
+    void handleRecordedData(const uint8_t *data, const uint8_t *dataEnd);
+    void pushEvent(Event::Type type, uint8_t keyCode = 0, uint16_t state = 0);
+
+    using AtomicKeyCodes = std::array<std::atomic<uint64_t>, 4>;
+    static void storeKeyCodes(AtomicKeyCodes &target, const KeyCodes &keyCodes);
+    static bool containsKeyCode(const AtomicKeyCodes &keyCodes, uint8_t keyCode);
+
+    xcb_connection_t *m_connection = nullptr;
+    uint32_t m_context = 0;
+    int m_commandPipe[2] = {-1, -1};
+    //! The state last requested by setEnabled()
+    bool m_enabled = false;
+
+    AtomicKeyCodes m_modifierKeyCodes = {};
+    AtomicKeyCodes m_releaseKeyCodes = {};
+    //! Only written to by the reader thread
+    std::atomic<bool> m_keyboardGrabbed = false;
+
+    // Only used by the reader thread once it runs
+    unsigned int m_cookieSequence = 0;
+    bool m_lastWasReset = false;
+    //! The time of the last input read
+    uint32_t m_lastTime = 0;
+
+    //! Protects m_recordedTime and m_awaitedTime
+    QMutex m_timeMutex;
+    //! The time of the input whose events were pushed last, nullopt before there was any
+    std::optional<uint32_t> m_recordedTime;
+    //! The time isTimeRecorded() was asked for last and which wasn't reached then
+    std::optional<uint32_t> m_awaitedTime;
+
+    static constexpr uint32_t s_ringSize = 1024;
+    std::array<Event, s_ringSize> m_ring;
+    //! Position of the next event to take, only written to by the consumer
+    std::atomic<uint32_t> m_ringHead = 0;
+    //! Position of the next event to push, only written to by the producer
+    std::atomic<uint32_t> m_ringTail = 0;
+    //! Events were dropped because the ring was full
+    std::atomic<bool> m_ringOverflowed = false;
+    //! eventsAvailable() was emitted and the consumer didn't find the ring empty since
+    std::atomic<bool> m_wakeupPending = false;
+};
+
+#endif // XRECORDREADER_H
@@ -0,0 +1,116 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include "shortcuteventchannel.h"
+
+#include "logging.h"
+#include <config-kglobalaccel.h>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+static_assert(std::atomic<quint64>::is_always_lock_free, "The write index is shared with other processes");
+
+static constexpr size_t s_memorySize = sizeof(ShortcutEventChannel::Header) + ShortcutEventChannel::s_capacity * sizeof(ShortcutEventChannel::Record);
+
+std::unique_ptr<ShortcutEventChannel> ShortcutEventChannel::create()
+{
+#if HAVE_MEMFD_CREATE && HAVE_EVENTFD
+    const int memoryFd = memfd_create("kglobalaccel-events", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memoryFd < 0) {
+        qCWarning(KGLOBALACCELD) << "Failed to create the memory of an event channel:" << strerror(errno);
+        return nullptr;
+    }
+
+    void *memory = MAP_FAILED;
+    if (ftruncate(memoryFd, s_memorySize) == 0) {
+        memory = mmap(nullptr, s_memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    }
+    if (memory == MAP_FAILED) {
+        qCWarning(KGLOBALACCELD) << "Failed to map the memory of an event channel:" << strerror(errno);
+        close(memoryFd);
+        return nullptr;
+    }
+
+    // Clients must not resize the memory under our mapping, nor write to it
+    const int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#ifdef F_SEAL_FUTURE_WRITE
+    int result = fcntl(memoryFd, F_ADD_SEALS, seals | F_SEAL_FUTURE_WRITE);
+    if (result < 0 && errno == EINVAL) {
+        // Kernels before 5.1 don't know it, clients could write to the memory then
+        qCDebug(KGLOBALACCELD) << "Cannot seal the memory of an event channel against writes";
+        result = fcntl(memoryFd, F_ADD_SEALS, seals);
+    }
+#else
+    const int result = fcntl(memoryFd, F_ADD_SEALS, seals);
+#endif
+    if (result < 0) {
+        qCWarning(KGLOBALACCELD) << "Failed to seal the memory of an event channel:" << strerror(errno);
+        munmap(memory, s_memorySize);
+        close(memoryFd);
+        return nullptr;
+    }
+
+    const int notifierFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (notifierFd < 0) {
+        qCWarning(KGLOBALACCELD) << "Failed to create the notifier of an event channel:" << strerror(errno);
+        munmap(memory, s_memorySize);
+        close(memoryFd);
+        return nullptr;
+    }
+
+    auto *header = new (memory) Header{s_magic, s_version, sizeof(Record), s_capacity, 0};
+    return std::unique_ptr<ShortcutEventChannel>(new ShortcutEventChannel(memoryFd, notifierFd, header));
+#else
+    return nullptr;
+#endif
+}
+
+ShortcutEventChannel::ShortcutEventChannel(int memoryFd, int notifierFd, Header *header)
+    : m_memoryFd(memoryFd)
+    , m_notifierFd(notifierFd)
+    , m_header(header)
+    , m_records(reinterpret_cast<Record *>(header + 1))
+{
+}
+
+ShortcutEventChannel::~ShortcutEventChannel()
+{
+    munmap(m_header, s_memorySize);
+    close(m_notifierFd);
+    close(m_memoryFd);
+}
+
+int ShortcutEventChannel::memoryFd() const
+{
+    return m_memoryFd;
+}
+
+int ShortcutEventChannel::notifierFd() const
+{
+    return m_notifierFd;
+}
+
+void ShortcutEventChannel::write(uint handle, ShortcutKeyState state, qint64 timestamp)
+{
+    const Record record{handle, quint32(state), timestamp};
+    std::memcpy(&m_records[m_writeIndex % s_capacity], &record, sizeof(Record));
+    m_header->writeIndex.store(++m_writeIndex, std::memory_order_release);
+
+    // Fails only if the counter would overflow, the client is readable then anyway
+    const quint64 one = 1;
+    if (::write(m_notifierFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        qCWarning(KGLOBALACCELD) << "Failed to notify an event channel:" << strerror(errno);
+    }
+}
@@ -0,0 +1,86 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef SHORTCUTEVENTCHANNEL_H
+#define SHORTCUTEVENTCHANNEL_H
+
+#include "shortcutkeystate.h"
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <memory>
+
+/**
+ * Shortcut events in shared memory, for clients which want them with the
+ * least latency, see KGlobalAccelD::openEventChannel().
+ *
+ * The memory is a memfd starting with a Header, followed by
+ * Header::capacity records. For every event the daemon writes the record at
+ * writeIndex % capacity, then increases writeIndex and adds one to the
+ * counter of the eventfd, which makes it readable.
+ *
+ * Readers keep their own read index. A record i may have been overwritten
+ * while it was read if writeIndex - i >= capacity afterwards: once
+ * writeIndex reaches i + capacity, record i + capacity, which takes its
+ * place, may be written.
+ */
+class ShortcutEventChannel
+{
+public:
+    struct Header {
+        //! s_magic
+        quint32 magic;
+        //! s_version
+        quint32 version;
+        //! sizeof(Record)
+        quint32 recordSize;
+        //! Number of records in the ring
+        quint32 capacity;
+        //! Number of records written so far
+        std::atomic<quint64> writeIndex;
+    };
+
+    struct Record {
+        //! See KGlobalAccelD::actionHandle()
+        quint32 handle;
+        //! A ShortcutKeyState
+        quint32 state;
+        qint64 timestamp;
+    };
+
+    static constexpr quint32 s_magic = 0x4b474145; // "KGAE"
+    static constexpr quint32 s_version = 1;
+    static constexpr quint32 s_capacity = 256;
+
+    /**
+     * Returns nullptr if the system has no memfd or eventfd, or creating
+     * them failed.
+     */
+    static std::unique_ptr<ShortcutEventChannel> create();
+
+    ~ShortcutEventChannel();
+
+    //! The memfd with the records, sealed against resizing
+    int memoryFd() const;
+
+    //! The eventfd which becomes readable when records were written
+    int notifierFd() const;
+
+    void write(uint handle, ShortcutKeyState state, qint64 timestamp);
+
+private:
+    ShortcutEventChannel(int memoryFd, int notifierFd, Header *header);
+
+    int m_memoryFd;
+    int m_notifierFd;
+    Header *m_header;
+    Record *m_records;
+    //! Kept here, what is in the memory is never read back
+    quint64 m_writeIndex = 0;
+};
+
+#endif